@@ -0,0 +1,104 @@
+/*
+ * alignbench.c - Benchmark for mm_memalign against the usual workaround
+ *
+ * Without an aligned entry point a program that needs, say, 64-byte
+ * alignment asks malloc for size + align - 1 bytes and rounds the
+ * pointer up, keeping the original around for free. This allocates
+ * BLOCKS blocks of mixed sizes at each alignment both ways, then frees
+ * them, and reports the time per block and the heap it took to hold
+ * them all at once (payload bytes over heap bytes, like mdriver's util).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "fsecs.h"
+
+#define BLOCKS    4000   /* blocks allocated per timed run */
+#define MIN_SHIFT 4      /* smallest alignment is 1 << MIN_SHIFT bytes */
+#define MAX_SHIFT 12     /* largest alignment is 1 << MAX_SHIFT bytes */
+
+int verbose = 0;         /* needed by fsecs.c */
+
+typedef struct {
+    size_t align;        /* alignment asked for */
+    int native;          /* 1: mm_memalign, 0: over-allocate and align */
+} bench_t;
+
+static void *raw[BLOCKS];       /* pointers to hand back to mm_free */
+static size_t sizes[BLOCKS];    /* payload size of each block */
+static size_t payload;          /* total payload bytes of a run */
+static size_t heap;             /* heap size with every block live */
+
+/*
+ * run_blocks - The timed function: allocate BLOCKS aligned blocks, then
+ *     free them all
+ */
+static void run_blocks(void *arg)
+{
+    bench_t *b = arg;
+    uintptr_t p;
+    int i;
+
+    mem_reset_brk();
+    if (mm_init() < 0) {
+        fprintf(stderr, "mm_init failed\n");
+        exit(1);
+    }
+
+    for (i = 0; i < BLOCKS; i++) {
+        if (b->native)
+            raw[i] = mm_memalign(b->align, sizes[i]);
+        else
+            raw[i] = mm_malloc(sizes[i] + b->align - 1);
+        if (raw[i] == NULL) {
+            fprintf(stderr, "allocation %d failed\n", i);
+            exit(1);
+        }
+        p = ((uintptr_t)raw[i] + b->align - 1) & ~(uintptr_t)(b->align - 1);
+        if (b->native && p != (uintptr_t)raw[i]) {
+            fprintf(stderr, "mm_memalign(%zu) returned %p\n", b->align, raw[i]);
+            exit(1);
+        }
+        *(char *)p = 0;
+    }
+    heap = mem_heapsize();
+
+    for (i = 0; i < BLOCKS; i++)
+        mm_free(raw[i]);
+}
+
+int main(void)
+{
+    bench_t b;
+    int i, shift;
+    double secs;
+
+    mem_init();
+    init_fsecs();
+
+    srand(1);
+    for (i = 0; i < BLOCKS; i++) {
+        sizes[i] = 16 + rand() % 1000;
+        payload += sizes[i];
+    }
+
+    printf("%8s %14s %8s %14s %8s\n", "align",
+           "memalign ns", "util", "workaround ns", "util");
+    for (shift = MIN_SHIFT; shift <= MAX_SHIFT; shift++) {
+        b.align = (size_t)1 << shift;
+        printf("%8zu", b.align);
+        for (b.native = 1; b.native >= 0; b.native--) {
+            secs = fsecs(run_blocks, &b);
+            printf(" %14.2f %7.0f%%", secs * 1e9 / BLOCKS,
+                   100.0 * payload / heap);
+        }
+        printf("\n");
+    }
+
+    mem_deinit();
+    return 0;
+}
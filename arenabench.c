@@ -0,0 +1,135 @@
+/*
+ * arenabench.c - Cross-thread free benchmark for the -DTHREADS arenas
+ *
+ * The threads form a ring: each one allocates blocks and passes them
+ * through a single-producer single-consumer queue to the next thread,
+ * which frees them.  The requests are mostly too big for the thread
+ * caches, so nearly every operation locks an arena, and every free
+ * goes to an arena owned by a different thread.  Run it once with
+ * MM_ARENAS=1 and once with more arenas to compare ("make arenacmp").
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#define MAX_THREADS 32       /* largest thread count measured */
+#define OPS         200000   /* blocks allocated per thread */
+#define RING        256      /* queue slots between neighbours */
+#define MAX_SIZE    2048     /* requests are 1..MAX_SIZE bytes */
+
+/* Queue from thread i to thread i+1, written by one and read by the other */
+typedef struct {
+    void *slot[RING];
+    unsigned int head __attribute__((aligned(64)));  /* next slot to read */
+    unsigned int tail __attribute__((aligned(64)));  /* next slot to write */
+} ring_t;
+
+static ring_t ring[MAX_THREADS];
+static int nthreads;
+static pthread_barrier_t start;
+
+/*
+ * push - Queue p for the consumer; return 0 if the ring is full
+ */
+static int push(ring_t *r, void *p)
+{
+    unsigned int tail = r->tail;
+
+    if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == RING)
+        return 0;
+    r->slot[tail % RING] = p;
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/*
+ * pop - Dequeue a block from the producer, or NULL if there is none
+ */
+static void *pop(ring_t *r)
+{
+    unsigned int head = r->head;
+    void *p;
+
+    if (head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    p = r->slot[head % RING];
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    return p;
+}
+
+/*
+ * worker - Allocate into the outgoing ring, free from the incoming one
+ */
+static void *worker(void *arg)
+{
+    int id = (int)(size_t)arg;
+    ring_t *out = &ring[id];
+    ring_t *in = &ring[(id + nthreads - 1) % nthreads];
+    unsigned int seed = id * 2654435761u + 1;
+    void *p;
+    int i;
+
+    pthread_barrier_wait(&start);
+    for (i = 0; i < OPS; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        if ((p = malloc(1 + seed % MAX_SIZE)) == NULL) {
+            fprintf(stderr, "malloc failed\n");
+            exit(1);
+        }
+        *(char *)p = (char)i;          /* touch the block */
+        if (!push(out, p))
+            free(p);
+        if ((p = pop(in)) != NULL)
+            free(p);
+    }
+
+    /* Everyone must stop producing before the rings are drained */
+    pthread_barrier_wait(&start);
+    while ((p = pop(in)) != NULL)
+        free(p);
+    return NULL;
+}
+
+/*
+ * run - Time OPS allocations on each of n threads, in seconds
+ */
+static double run(int n)
+{
+    pthread_t tid[MAX_THREADS];
+    struct timespec t0, t1;
+    int i;
+
+    nthreads = n;
+    pthread_barrier_init(&start, NULL, n);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < n; i++) {
+        if (pthread_create(&tid[i], NULL, worker, (void *)(size_t)i) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < n; i++)
+        pthread_join(tid[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    pthread_barrier_destroy(&start);
+
+    return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+int main(void)
+{
+    char *arenas = getenv("MM_ARENAS");
+    double secs;
+    int n;
+
+    printf("MM_ARENAS=%s\n", arenas ? arenas : "(default)");
+    printf("%8s %10s %10s\n", "threads", "secs", "Mops/s");
+    for (n = 8; n <= MAX_THREADS; n *= 2) {
+        secs = run(n);
+        printf("%8d %10.3f %10.2f\n", n, secs, 2.0 * n * OPS / secs / 1e6);
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * binbench.c - Micro-benchmark for the size-class lookup in mm.c
+ *
+ * Builds a heap whose only free block sits in a chosen size class and
+ * then times malloc/free pairs of a small request. Every malloc has to
+ * get past all the empty classes below that block, so the time per
+ * pair against the number of classes skipped shows what the lookup
+ * costs as a function of bin count.
+ *
+ * The request is just over QUICK_MAX, so that its frees are coalesced
+ * at once rather than parked on a quick list and handed straight back,
+ * and the free block stays under MMAP_MIN, so that it is in the heap.
+ * Blocks past the last class are in the splay tree.  A run that takes
+ * no longer than timing an empty function says nothing about the
+ * lookup, so such samples are dropped and shown as "--".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "fsecs.h"
+
+#define PAIRS     100000 /* malloc/free pairs per timed run */
+#define REQUEST   136    /* payload bytes of each timed malloc */
+#define CHUNK     4096   /* mm.c's initial heap extension */
+#define MIN_SHIFT 8      /* smallest free block is 1 << MIN_SHIFT bytes */
+#define MAX_SHIFT 16     /* largest free block is 1 << MAX_SHIFT bytes */
+#define TRIES     3      /* timed runs per block size, best one kept */
+
+int verbose = 0;         /* needed by fsecs.c */
+
+/*
+ * setup_heap - Reset the heap so that it holds a single free block of
+ *     about bytes bytes, fenced in by allocated blocks on both sides.
+ */
+static void setup_heap(size_t bytes)
+{
+    void *big;
+
+    mem_reset_brk();
+    if (mm_init() < 0) {
+        fprintf(stderr, "mm_init failed\n");
+        exit(1);
+    }
+
+    /* Use up the initial chunk, then carve and fence the big block */
+    if (mm_malloc(CHUNK - 8) == NULL ||
+        (big = mm_malloc(bytes - 8)) == NULL ||
+        mm_malloc(CHUNK - 8) == NULL) {
+        fprintf(stderr, "setup_heap(%zu) failed\n", bytes);
+        exit(1);
+    }
+    mm_free(big);
+}
+
+/*
+ * run_pairs - The timed function: PAIRS small malloc/free pairs
+ */
+static void run_pairs(void *arg __attribute__((unused)))
+{
+    int i;
+    void *p;
+
+    for (i = 0; i < PAIRS; i++) {
+        if ((p = mm_malloc(REQUEST)) == NULL) {
+            fprintf(stderr, "mm_malloc failed\n");
+            exit(1);
+        }
+        mm_free(p);
+    }
+}
+
+/*
+ * run_nothing - Times what fsecs() itself costs
+ */
+static void run_nothing(void *arg __attribute__((unused)))
+{
+}
+
+int main(void)
+{
+    int shift, i;
+    double secs, best, base;
+
+    mem_init();
+    init_fsecs();
+    base = fsecs(run_nothing, NULL);
+
+    printf("%10s %12s\n", "free blk", "ns/pair");
+    for (shift = MIN_SHIFT; shift <= MAX_SHIFT; shift++) {
+        best = 0;
+        for (i = 0; i < TRIES; i++) {
+            setup_heap((size_t)1 << shift);
+            secs = fsecs(run_pairs, NULL);
+            if (secs > 2 * base && (best == 0 || secs < best))
+                best = secs;
+        }
+        if (best > 0)
+            printf("%10lu %12.2f\n", 1UL << shift,
+                   (best - base) * 1e9 / PAIRS);
+        else
+            printf("%10lu %12s\n", 1UL << shift, "--");
+    }
+
+    mem_deinit();
+    return 0;
+}
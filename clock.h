@@ -6,6 +6,9 @@ void start_counter();
 /* Get # cycles since counter started */
 double get_counter();
 
+/* Read the counter itself: cheap enough to time single short calls */
+unsigned long long read_counter();
+
 /* Measure overhead for counter */
 double ovhd();
 
@@ -0,0 +1,74 @@
+#!/bin/sh
+#
+# fitcmp.sh - Run several builds of the driver over the same traces and
+#     print their util, Kops and stride (mean bytes between successive
+#     mallocs, from mdriver -r) for each trace side by side, followed by
+#     each build's perf index
+#
+# usage: ./fitcmp.sh mdriver-first mdriver-best ... [-- mdriver flags]
+#
+# make fitcmp runs it on every mdriver-<policy>, and make ordercmp on
+# LIFO and address-ordered free lists; mdriver flags such as
+# -f <file> or -t <dir> pick the traces (the default ones otherwise).
+#
+drivers=
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+    drivers="$drivers $1"
+    shift
+done
+[ "$1" = "--" ] && shift
+if [ -z "$drivers" ]; then
+    echo "usage: $0 mdriver-<policy>... [-- mdriver flags]" >&2
+    exit 1
+fi
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+i=0
+for d in $drivers; do
+    i=$((i + 1))
+    f=$(printf "%s/%03d" "$tmp" $i)
+    echo "$d" > "$f"
+    ./"$d" -v 1 -r "$@" >> "$f" || exit 1
+done
+
+awk '
+    FNR == 1 { n++; name[n] = $1; next }
+    $NF ~ /\.rep$/ && ($1 == "yes" || $2 == "yes" || $1 == "no" || $2 == "no") {
+        t = $NF
+        sub(/.*\//, "", t)
+        if (!(t in seen)) { seen[t] = 1; order[++ntraces] = t }
+        if ($1 == "no" || $2 == "no") {
+            util[t, n] = kops[t, n] = stride[t, n] = "-"
+        } else {
+            util[t, n] = kops[t, n] = "--"
+            for (f = 1; f <= NF; f++)
+                if ($f ~ /%$/ || $f == "--") {
+                    util[t, n] = $f; kops[t, n] = $(f + 3); break
+                }
+            stride[t, n] = $(NF - 1)
+        }
+    }
+    /^Perf index/ { perf[n] = $NF }
+    END {
+        printf "%-22s", "trace"
+        for (j = 1; j <= n; j++)
+            printf " %25s", name[j]
+        printf "\n%-22s", ""
+        for (j = 1; j <= n; j++)
+            printf " %6s %9s %8s", "util", "Kops", "stride"
+        printf "\n"
+        for (k = 1; k <= ntraces; k++) {
+            t = order[k]
+            printf "%-22s", t
+            for (j = 1; j <= n; j++)
+                printf " %6s %9s %8s", util[t, j], kops[t, j], stride[t, j]
+            printf "\n"
+        }
+        printf "%-22s", "perf index"
+        for (j = 1; j <= n; j++)
+            printf " %25s", perf[j]
+        printf "\n"
+    }
+' "$tmp"/*
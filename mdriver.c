@@ -23,8 +23,20 @@
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
 #include "config.h"
 
+/* The entry points beyond malloc, free and realloc are optional: a
+   package without them still links, and the flags and trace ops that
+   need them are refused */
+#pragma weak mm_malloc_batch
+#pragma weak mm_free_batch
+#pragma weak mm_free_sized
+#pragma weak mm_memalign
+#pragma weak mm_usable_size
+#pragma weak mm_good_size
+#pragma weak mm_stats
+
 /**********************
  * Constants and macros
  **********************/
@@ -37,6 +49,13 @@
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
 
+/* Latency histograms split each power of two of cycles into LAT_SUB
+   buckets, so a percentile is exact to within 1/LAT_SUB of itself */
+#define LAT_SUB_LOG2 2
+#define LAT_SUB      (1 << LAT_SUB_LOG2)
+#define LAT_BUCKETS  (64 * LAT_SUB)
+#define LAT_CALIBRATE 10000  /* empty timings taken to find the overhead */
+
 /* weights */
 #define WNONE 0
 #define WALL 1
@@ -64,9 +83,11 @@ typedef struct range_t {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum { ALLOC, FREE, REALLOC } type; /* type of request */
+    enum { ALLOC, FREE, REALLOC, MEMALIGN } type; /* type of request */
     int index;                        /* index for free() to use later */
-    size_t size;                      /* byte size of alloc/realloc request */
+    size_t align;                     /* alignment of a memalign request */
+    size_t size;                      /* byte size of alloc/realloc request,
+                                         or of the block that free frees */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -80,6 +101,7 @@ typedef struct {
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
     int *block_rand_base;/* index into random_data, if debug is on */
+    void **batch;        /* pointers of the current batch, with -b */
 } trace_t;
 
 /*
@@ -92,6 +114,16 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* Histogram of the cycles one kind of request took */
+typedef struct {
+    unsigned long count[LAT_BUCKETS];  /* requests per bucket */
+    unsigned long n;                   /* requests in all */
+    unsigned long long max;            /* the slowest one */
+} hist_t;
+
+/* The kinds of request timed with -L */
+enum { LAT_MALLOC, LAT_FREE, LAT_REALLOC, LAT_KINDS };
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* set in read_trace */
@@ -105,6 +137,14 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    size_t heapsize; /* heap size at the end of the util run */
+    size_t resident; /* resident heap and mapped bytes at that point */
+    size_t sbrks;    /* mem_sbrk calls during the util run */
+    size_t reallocs; /* mm_realloc calls during the util run */
+    double stride;   /* mean distance between successive heap mallocs */
+    mm_stats_t peak; /* mm_stats() at the util run's payload peak (-S) */
+    mm_stats_t end;  /* ... and at its end */
+    hist_t lat[LAT_KINDS]; /* cycles per request by kind (-L) */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -137,6 +177,29 @@ int onetime_flag = 0;
 /* by default, no timeouts */
 static int set_timeout = 0;
 
+/* If set, report heap and resident sizes and sbrk calls for each trace (-r) */
+static int report_mem = 0;
+
+/* If set, replay runs of same-size mallocs and runs of frees with
+   mm_malloc_batch() and mm_free_batch() (-b) */
+static int batch_mode = 0;
+
+/* If set, free with mm_free_sized() and the block's size (-z) */
+static int sized_free = 0;
+
+/* If set, skip reallocs that fit in mm_usable_size() of the block, as a
+   growable buffer that knows its capacity would (-g) */
+static int grow_in_place = 0;
+
+/* If set, print the mm_stats() heap statistics for each trace (-S) */
+static int heap_stats = 0;
+
+/* If set, time every request and print latency percentiles (-L) */
+static int latency_mode = 0;
+
+/* Cycles a timing of nothing at all takes, taken off every timing */
+static unsigned long long lat_overhead;
+
 
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
@@ -168,6 +231,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
                            const char *filename);
 static void reinit_trace(trace_t *trace);
 static void free_trace(trace_t *trace);
+static int batch_run(const trace_t *trace, int opnum);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace);
@@ -176,11 +240,15 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum);
+static double eval_mm_util(trace_t *trace, int tracenum, stats_t *stats);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, stats_t *stats);
+static void lat_calibrate(void);
 
 /* Various helper routines */
-static void printresults(int n, stats_t *stats);
+static void printresults(int n, stats_t *stats, int mem);
+static void printheapstats(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
 static void usage(void);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3,4)));
@@ -198,6 +266,35 @@ static void timeout_handler(int sig __attribute__((unused))) {
     longjmp(timeout_jmpbuf, 1);
 }
 
+/*
+ * check_extensions - Refuse the flags whose entry points the package
+ *     does not provide
+ */
+static void check_extensions(void)
+{
+    if (batch_mode && (mm_malloc_batch == NULL || mm_free_batch == NULL))
+        app_error("-b needs mm_malloc_batch and mm_free_batch\n");
+    if (sized_free && mm_free_sized == NULL)
+        app_error("-z needs mm_free_sized\n");
+    if (grow_in_place && (mm_usable_size == NULL || mm_good_size == NULL))
+        app_error("-g needs mm_usable_size and mm_good_size\n");
+    if (heap_stats && mm_stats == NULL)
+        app_error("-S needs mm_stats\n");
+}
+
+/*
+ * has_memalign - Return whether the trace has any memalign requests
+ */
+static int has_memalign(trace_t *trace)
+{
+    int i;
+
+    for (i = 0; i < trace->num_ops; i++)
+        if (trace->ops[i].type == MEMALIGN)
+            return 1;
+    return 0;
+}
+
 /* Run the tests; return the number of tests run (may be less than
    num_tracefiles, if there's a timeout) */
 static void run_tests(int num_tracefiles, const char *tracedir,
@@ -222,6 +319,11 @@ static void run_tests(int num_tracefiles, const char *tracedir,
         mm_stats[i].ops = trace->num_ops;
         if(timed_out) {
             mm_stats[i].valid = 0;
+        } else if (mm_memalign == NULL && has_memalign(trace)) {
+            printf("ERROR [trace %s]: memalign requests need mm_memalign\n",
+                   trace->filename);
+            errors++;
+            mm_stats[i].valid = 0;
         } else {
             if (verbose > 1)
                 printf("Checking mm_malloc for correctness, ");
@@ -235,12 +337,14 @@ static void run_tests(int num_tracefiles, const char *tracedir,
         if (mm_stats[i].valid) {
             if (verbose > 1)
                 printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i);
+            mm_stats[i].util = eval_mm_util(trace, i, &mm_stats[i]);
             speed_params->trace = trace;
             speed_params->ranges = ranges;
             if (verbose > 1)
                 printf("and performance.\n");
             mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+            if (latency_mode)
+                eval_mm_latency(trace, &mm_stats[i]);
         }
 
         free_trace(trace);
@@ -280,7 +384,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlD")) != EOF) {
+    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlDrbzgSL")) != EOF) {
         switch (c) {
 
         case 'A': /* Hidden Autolab driver argument */
@@ -338,6 +442,30 @@ int main(int argc, char **argv)
             set_timeout = atoi(optarg);
             break;
 
+        case 'r': /* Report memory use, realloc calls and locality */
+            report_mem = 1;
+            break;
+
+        case 'b': /* Replay runs of requests as batches */
+            batch_mode = 1;
+            break;
+
+        case 'z': /* Tell free the size of the block */
+            sized_free = 1;
+            break;
+
+        case 'g': /* Grow blocks into their slack without realloc */
+            grow_in_place = 1;
+            break;
+
+        case 'S': /* Print heap statistics */
+            heap_stats = 1;
+            break;
+
+        case 'L': /* Print latency percentiles */
+            latency_mode = 1;
+            break;
+
         case 'h': /* Print this message */
             usage();
             exit(0);
@@ -348,6 +476,8 @@ int main(int argc, char **argv)
         }
     }
 
+    check_extensions();
+
     if (tracefiles == NULL) {
         tracefiles = default_tracefiles;
         num_tracefiles = sizeof(default_tracefiles) / sizeof(char *) - 1;
@@ -360,6 +490,8 @@ int main(int argc, char **argv)
 
     /* Initialize the timing package */
     init_fsecs();
+    if (latency_mode)
+        lat_calibrate();
 
     /* Initialize the timeout */
     if (set_timeout > 0) {
@@ -398,7 +530,7 @@ int main(int argc, char **argv)
         /* Display the libc results in a compact table */
         if (verbose) {
             printf("\nResults for libc malloc:\n");
-            printresults(num_tracefiles, libc_stats);
+            printresults(num_tracefiles, libc_stats, 0);
         }
     }
 
@@ -428,8 +560,16 @@ int main(int argc, char **argv)
             }
         } else {
             printf("\nResults for mm malloc:\n");
-            printresults(num_tracefiles, mm_stats);
+            printresults(num_tracefiles, mm_stats, report_mem);
             printf("\n");
+            if (heap_stats) {
+                printheapstats(num_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (latency_mode) {
+                printlatency(num_tracefiles, mm_stats);
+                printf("\n");
+            }
         }
     }
 
@@ -562,21 +702,27 @@ static int add_range(range_t **ranges, char *lo, int size,
 {
     char *hi = lo + size - 1;
     range_t *p;
+    size_t align = trace->ops[opnum].type == MEMALIGN ?
+        trace->ops[opnum].align : ALIGNMENT;
 
     assert(size > 0);
 
-    /* Payload addresses must be ALIGNMENT-byte aligned */
-    if (!IS_ALIGNED(lo)) {
+    /* Payload addresses must be ALIGNMENT-byte aligned, or aligned as
+     * the memalign request asked */
+    if (!IS_ALIGNED(lo) || (size_t)lo % align != 0) {
         malloc_error(trace, opnum,
-                     "Payload address (%p) not aligned to %d bytes", lo, ALIGNMENT);
+                     "Payload address (%p) not aligned to %zu bytes", lo,
+                     align > ALIGNMENT ? align : ALIGNMENT);
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap, or within
+     * one of the mappings the package has made with mem_map() */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+         (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+        !mem_mapped(lo, hi)) {
         malloc_error(trace, opnum,
-                     "Payload (%p:%p) lies outside heap (%p:%p)",
+                     "Payload (%p:%p) lies outside heap (%p:%p) and mappings",
                      lo, hi, mem_heap_lo(), mem_heap_hi());
         return 0;
     }
@@ -720,7 +866,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     FILE *tracefile;
     trace_t *trace;
     char type[MAXLINE];
-    int index, size;
+    int index, size, align;
     int max_index = 0;
     int op_index;
 
@@ -769,6 +915,11 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
          calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
         unix_error("malloc 5 failed in read_trace");
 
+    /* and room for the longest possible batch */
+    if ((trace->batch =
+         calloc(trace->num_ops, sizeof(*trace->batch))) == NULL)
+        unix_error("malloc 6 failed in read_trace");
+
 
     /* read every request line in the trace file */
     index = 0;
@@ -781,6 +932,8 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
             trace->ops[op_index].index = index;
             trace->ops[op_index].size = size;
             max_index = (index > max_index) ? index : max_index;
+            if (index < trace->num_ids)
+                trace->block_sizes[index] = size;
             break;
         case 'r':
             fscanf(tracefile, "%u %u", &index, &size);
@@ -788,11 +941,25 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
             trace->ops[op_index].index = index;
             trace->ops[op_index].size = size;
             max_index = (index > max_index) ? index : max_index;
+            if (index < trace->num_ids)
+                trace->block_sizes[index] = size;
+            break;
+        case 'm':
+            fscanf(tracefile, "%u %u %u", &index, &size, &align);
+            trace->ops[op_index].type = MEMALIGN;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].size = size;
+            trace->ops[op_index].align = align;
+            max_index = (index > max_index) ? index : max_index;
+            if (index < trace->num_ids)
+                trace->block_sizes[index] = size;
             break;
         case 'f':
             fscanf(tracefile, "%ud", &index);
             trace->ops[op_index].type = FREE;
             trace->ops[op_index].index = index;
+            trace->ops[op_index].size = (index >= 0 && index < trace->num_ids) ?
+                trace->block_sizes[index] : 0;
             break;
         default:
             app_error("Bogus type character (%c) in tracefile %s\n",
@@ -824,7 +991,7 @@ static void reinit_trace(trace_t *trace)
 }
 
 /*
- * free_trace - Free the trace record and the four arrays it points
+ * free_trace - Free the trace record and the five arrays it points
  *              to, all of which were allocated in read_trace().
  */
 static void free_trace(trace_t *trace)
@@ -833,9 +1000,28 @@ static void free_trace(trace_t *trace)
     free(trace->blocks);
     free(trace->block_sizes);
     free(trace->block_rand_base);
+    free(trace->batch);
     free(trace);              /* and the trace record itself... */
 }
 
+/*
+ * batch_run - The number of ops from opnum on that -b replays as one
+ *     batch: a run of mallocs of the same size, or a run of frees.
+ *     Reallocs and memaligns are never batched.
+ */
+static int batch_run(const trace_t *trace, int opnum)
+{
+    const traceop_t *op = &trace->ops[opnum];
+    int n = 1;
+
+    if (op->type != ALLOC && op->type != FREE)
+        return 1;
+    while (opnum + n < trace->num_ops && op[n].type == op->type &&
+           (op->type == FREE || op[n].size == op->size))
+        n++;
+    return n;
+}
+
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -852,6 +1038,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
     char *newp;
     char *oldp;
     char *p;
+    int n = 0, k = 0;  /* length of the current batch and position in it */
 
     /* Reset the heap and free any records in the range list */
     mem_reset_brk();
@@ -883,12 +1070,33 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             }
         }
 
+        /* With -b, a run of mallocs is allocated all at once, and a
+         * run of frees is freed once its last op has been checked */
+        if (k == n) {
+            n = batch_mode ? batch_run(trace, i) : 1;
+            k = 0;
+            if (n > 1 && trace->ops[i].type == ALLOC &&
+                mm_malloc_batch(size, n, trace->batch) != (size_t)n) {
+                malloc_error(trace, i, "mm_malloc_batch failed.");
+                return 0;
+            }
+        }
+
         switch (trace->ops[i].type) {
 
+        case MEMALIGN: /* mm_memalign */
         case ALLOC: /* mm_malloc */
 
             /* Call the student's malloc */
-            if ((p = mm_malloc(size)) == NULL) {
+            if (n > 1)
+                p = trace->batch[k];
+            else if (trace->ops[i].type == MEMALIGN) {
+                if ((p = mm_memalign(trace->ops[i].align, size)) == NULL) {
+                    malloc_error(trace, i, "mm_memalign failed.");
+                    return 0;
+                }
+            }
+            else if ((p = mm_malloc(size)) == NULL) {
                 malloc_error(trace, i, "mm_malloc failed.");
                 return 0;
             }
@@ -901,6 +1109,16 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             if (add_range(ranges, p, size, trace, i, index) == 0)
                 return 0;
 
+            /* With -g, the block must have the room mm_good_size()
+               promised */
+            if (grow_in_place &&
+                mm_usable_size(p) < (trace->ops[i].type == ALLOC ?
+                                     mm_good_size(size) : (size_t)size)) {
+                malloc_error(trace, i, "mm_usable_size (%zu) too small for "
+                             "a request of %zu bytes", mm_usable_size(p), size);
+                return 0;
+            }
+
             /* Remember region */
             trace->blocks[index] = p;
             trace->block_sizes[index] = size;
@@ -912,9 +1130,12 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
         case REALLOC: /* mm_realloc */
             check_index(trace, i, index);
 
-            /* Call the student's realloc */
+            /* Call the student's realloc, unless the block has room */
             oldp = trace->blocks[index];
-            newp = mm_realloc(oldp, size);
+            if (grow_in_place && size > 0 && size <= mm_usable_size(oldp))
+                newp = oldp;
+            else
+                newp = mm_realloc(oldp, size);
             if( (newp == NULL) && (size != 0) ) {
                 malloc_error(trace, i, "mm_realloc failed.");
                 return 0;
@@ -959,13 +1180,20 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
                 p = trace->blocks[index];
                 remove_range(ranges, p);
             }
-            mm_free(p);
+            if (n > 1) {
+                if ((trace->batch[k] = p, k == n - 1))
+                    mm_free_batch(trace->batch, n);
+            }
+            else if (sized_free)
+                mm_free_sized(p, size);
+            else
+                mm_free(p);
             break;
 
         default:
             app_error("Nonexistent request type in eval_mm_valid");
         }
-
+        k++;
     }
 
     /* As far as we know, this is a valid malloc package */
@@ -976,15 +1204,24 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
  * eval_mm_util - Evaluate the space utilization of the student's package
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
- *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   Utilization is the ratio hwm/footprint, where footprint is the
+ *   largest amount of memory the student's malloc package held at
+ *   any one time while running the trace: the heap plus any pages
+ *   it mapped with mem_map().  For a package that never shrinks the
+ *   heap and only uses mem_sbrk(), this is the final heap size.
  *
  *   A higher number is better: 1 is optimal.
+ *
+ *   The heap size and the resident bytes at the end of the run are
+ *   left in stats, so that memory handed back to the system shows,
+ *   and so is the number of mem_sbrk() calls the run made.  So is a
+ *   measure of locality: the mean distance in bytes from each block
+ *   malloc returns in the heap to the one it returned before (mapped
+ *   blocks are left out, as their distance from the heap means
+ *   nothing).  The smaller it is, the more the trace's consecutive
+ *   blocks share pages and cache lines.
  */
-static double eval_mm_util(trace_t *trace, int tracenum)
+static double eval_mm_util(trace_t *trace, int tracenum, stats_t *stats)
 {
     int i;
     int index;
@@ -993,22 +1230,46 @@ static double eval_mm_util(trace_t *trace, int tracenum)
     int total_size = 0;
     char *p;
     char *newp, *oldp;
+    int n = 0, k = 0;  /* length of the current batch and position in it */
+    char *last = NULL; /* the last block malloc returned in the heap */
+    double dist = 0;   /* total distance between such blocks */
+    size_t steps = 0;  /* ... and the number of distances added up */
 
     reinit_trace(trace);
 
-    /* initialize the heap and the mm malloc package */
+    /* initialize the heap and the mm malloc package, dropping the
+     * pages the validity run left resident */
+    mem_release(mem_heap_lo(), mem_heapsize());
     mem_reset_brk();
     if (mm_init() < 0)
         app_error("trace %d: mm_init failed in eval_mm_util", tracenum);
 
     for (i = 0;  i < trace->num_ops;  i++) {
+        if (k == n) {
+            n = batch_mode ? batch_run(trace, i) : 1;
+            k = 0;
+            if (n > 1 && trace->ops[i].type == ALLOC &&
+                mm_malloc_batch(trace->ops[i].size, n, trace->batch) !=
+                (size_t)n)
+                app_error("trace %d: mm_malloc_batch failed in eval_mm_util",
+                          tracenum);
+        }
+
         switch (trace->ops[i].type) {
 
+        case MEMALIGN: /* mm_memalign */
         case ALLOC: /* mm_alloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
 
-            if ((p = mm_malloc(size)) == NULL) {
+            if (n > 1)
+                p = trace->batch[k];
+            else if (trace->ops[i].type == MEMALIGN) {
+                if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+                    app_error("trace %d: mm_memalign failed in eval_mm_util",
+                              tracenum);
+            }
+            else if ((p = mm_malloc(size)) == NULL) {
                 app_error("trace %d: mm_malloc failed in eval_mm_util",
                           tracenum);
             }
@@ -1017,6 +1278,15 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             trace->blocks[index] = p;
             trace->block_sizes[index] = size;
 
+            /* Measure the step from the previous heap block */
+            if (p >= (char *)mem_heap_lo() && p <= (char *)mem_heap_hi()) {
+                if (last != NULL) {
+                    dist += p > last ? p - last : last - p;
+                    steps++;
+                }
+                last = p;
+            }
+
             total_size += size;
             break;
 
@@ -1026,9 +1296,14 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             oldsize = trace->block_sizes[index];
 
             oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0) {
-                app_error("trace %d: mm_realloc failed in eval_mm_util",
-                          tracenum);
+            if (grow_in_place && newsize > 0 &&
+                (size_t)newsize <= mm_usable_size(oldp))
+                newp = oldp;
+            else {
+                stats->reallocs++;
+                if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0)
+                    app_error("trace %d: mm_realloc failed in eval_mm_util",
+                              tracenum);
             }
 
             /* Remember region and size */
@@ -1048,7 +1323,14 @@ static double eval_mm_util(trace_t *trace, int tracenum)
                 p = trace->blocks[index];
             }
 
-            mm_free(p);
+            if (n > 1) {
+                if ((trace->batch[k] = p, k == n - 1))
+                    mm_free_batch(trace->batch, n);
+            }
+            else if (sized_free)
+                mm_free_sized(p, size);
+            else
+                mm_free(p);
 
             total_size -= size;
             break;
@@ -1057,15 +1339,25 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             app_error("trace %d: Nonexistent request type in eval_mm_util",
                       tracenum);
         }
+        k++;
 
         /* update the high-water mark */
-        max_total_size = (total_size > max_total_size) ?
-            total_size : max_total_size;
+        if (total_size > max_total_size) {
+            max_total_size = total_size;
+            if (heap_stats)
+                mm_stats(&stats->peak);
+        }
     }
+    if (heap_stats)
+        mm_stats(&stats->end);
 
     printf(".");
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    stats->heapsize = mem_heapsize();
+    stats->resident = mem_resident();
+    stats->stride = steps ? dist / steps : 0;
+    stats->sbrks = mem_sbrk_calls();
+    return ((double)max_total_size / (double)mem_peak());
 }
 
 
@@ -1075,7 +1367,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, k, n, index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
     reinit_trace(trace);
@@ -1092,28 +1384,59 @@ static void eval_mm_speed(void *ptr)
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
+            if (batch_mode && (n = batch_run(trace, i)) > 1) {
+                if (mm_malloc_batch(size, n, trace->batch) != (size_t)n)
+                    app_error("mm_malloc_batch error in eval_mm_speed");
+                for (k = 0; k < n; k++)
+                    trace->blocks[trace->ops[i+k].index] = trace->batch[k];
+                i += n - 1;
+                break;
+            }
             if ((p = mm_malloc(size)) == NULL)
                 app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
 
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+                app_error("mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
         case REALLOC: /* mm_realloc */
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
             oldp = trace->blocks[index];
+            if (grow_in_place && newsize > 0 &&
+                (size_t)newsize <= mm_usable_size(oldp))
+                break;
             if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0)
                 app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
             break;
 
         case FREE: /* mm_free */
+            if (batch_mode && (n = batch_run(trace, i)) > 1) {
+                for (k = 0; k < n; k++) {
+                    index = trace->ops[i+k].index;
+                    trace->batch[k] = index < 0 ? NULL : trace->blocks[index];
+                }
+                mm_free_batch(trace->batch, n);
+                i += n - 1;
+                break;
+            }
             index = trace->ops[i].index;
             if(index < 0) {
                 block = 0;
             } else {
                 block = trace->blocks[index];
             }
-            mm_free(block);
+            if (sized_free)
+                mm_free_sized(block, trace->ops[i].size);
+            else
+                mm_free(block);
             break;
 
         default:
@@ -1121,6 +1444,173 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * lat_bucket - The histogram bucket of a request that took c cycles:
+ *     c itself below LAT_SUB, and above that the power of two c lies in
+ *     and which of its LAT_SUB slices
+ */
+static int lat_bucket(unsigned long long c)
+{
+    int e;
+
+    if (c < LAT_SUB)
+        return (int)c;
+    e = 63 - __builtin_clzll(c);
+    return e * LAT_SUB + (int)((c >> (e - LAT_SUB_LOG2)) & (LAT_SUB - 1));
+}
+
+/*
+ * lat_bucket_top - The most cycles a request in bucket b can have taken
+ */
+static unsigned long long lat_bucket_top(int b)
+{
+    int e = b / LAT_SUB;
+
+    if (b < LAT_SUB)
+        return b;
+    return ((unsigned long long)(LAT_SUB + b % LAT_SUB + 1)
+            << (e - LAT_SUB_LOG2)) - 1;
+}
+
+/*
+ * lat_record - Add a request timed from counter reading t0 to t1 to h,
+ *     less the timing overhead and clamped at 0.  A request over which
+ *     the counter went backwards (the thread moved to a CPU whose
+ *     counter lags) is dropped.
+ */
+static void lat_record(hist_t *h, unsigned long long t0,
+                       unsigned long long t1)
+{
+    unsigned long long c;
+
+    if (t1 < t0)
+        return;
+    c = t1 - t0 > lat_overhead ? t1 - t0 - lat_overhead : 0;
+    h->count[lat_bucket(c)]++;
+    h->n++;
+    if (c > h->max)
+        h->max = c;
+}
+
+/*
+ * lat_percentile - The cycles within which the fraction q of the
+ *     requests in h finished, rounded up to the top of their bucket
+ */
+static unsigned long long lat_percentile(const hist_t *h, double q)
+{
+    unsigned long want = (unsigned long)(q * h->n + 0.999999), seen = 0;
+    int b;
+
+    for (b = 0; b < LAT_BUCKETS; b++)
+        if ((seen += h->count[b]) >= want && seen > 0)
+            break;
+    if (b == LAT_BUCKETS || lat_bucket_top(b) > h->max)
+        return h->max;
+    return lat_bucket_top(b);
+}
+
+static int cmp_cycles(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * lat_calibrate - Set lat_overhead to the median of LAT_CALIBRATE
+ *     timings of nothing, which is what read_counter() itself adds to
+ *     every timed request
+ */
+static void lat_calibrate(void)
+{
+    static unsigned long long t[LAT_CALIBRATE];
+    unsigned long long t0, t1;
+    int i;
+
+    for (i = 0; i < LAT_CALIBRATE; i++) {
+        t0 = read_counter();
+        t1 = read_counter();
+        t[i] = t1 > t0 ? t1 - t0 : 0;
+    }
+    qsort(t, LAT_CALIBRATE, sizeof(t[0]), cmp_cycles);
+    lat_overhead = t[LAT_CALIBRATE / 2];
+}
+
+/*
+ * eval_mm_latency - Run the trace once more, after the speed runs,
+ *    timing each request on its own with read_counter() and adding the
+ *    cycles it took to the histograms in stats.  Batches (-b) are not
+ *    used, since their requests cannot be timed one by one, and a
+ *    realloc that -g skips is not a request.
+ */
+static void eval_mm_latency(trace_t *trace, stats_t *stats)
+{
+    int i, index, size;
+    char *p, *oldp;
+    unsigned long long t0, t1;
+
+    reinit_trace(trace);
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_latency");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+            t0 = read_counter();
+            p = mm_malloc(size);
+            t1 = read_counter();
+            if (p == NULL)
+                app_error("mm_malloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            lat_record(&stats->lat[LAT_MALLOC], t0, t1);
+            break;
+
+        case MEMALIGN: /* mm_memalign, timed as a malloc */
+            t0 = read_counter();
+            p = mm_memalign(trace->ops[i].align, size);
+            t1 = read_counter();
+            if (p == NULL)
+                app_error("mm_memalign error in eval_mm_latency");
+            trace->blocks[index] = p;
+            lat_record(&stats->lat[LAT_MALLOC], t0, t1);
+            break;
+
+        case REALLOC: /* mm_realloc */
+            oldp = trace->blocks[index];
+            if (grow_in_place && size > 0 &&
+                (size_t)size <= mm_usable_size(oldp))
+                break;
+            t0 = read_counter();
+            p = mm_realloc(oldp, size);
+            t1 = read_counter();
+            if (p == NULL && size != 0)
+                app_error("mm_realloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            lat_record(&stats->lat[LAT_REALLOC], t0, t1);
+            break;
+
+        case FREE: /* mm_free */
+            p = index < 0 ? NULL : trace->blocks[index];
+            t0 = read_counter();
+            if (sized_free)
+                mm_free_sized(p, size);
+            else
+                mm_free(p);
+            t1 = read_counter();
+            lat_record(&stats->lat[LAT_FREE], t0, t1);
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_mm_latency");
+        }
+    }
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1145,6 +1635,15 @@ static int eval_libc_valid(trace_t *trace)
             trace->blocks[trace->ops[i].index] = p;
             break;
 
+        case MEMALIGN: /* posix_memalign */
+            if (posix_memalign((void **)&p, trace->ops[i].align,
+                               trace->ops[i].size) != 0) {
+                malloc_error(trace, i, "libc posix_memalign failed");
+                unix_error("System message");
+            }
+            trace->blocks[trace->ops[i].index] = p;
+            break;
+
         case REALLOC: /* realloc */
             newsize = trace->ops[i].size;
             oldp = trace->blocks[trace->ops[i].index];
@@ -1195,6 +1694,14 @@ static void eval_libc_speed(void *ptr)
             trace->blocks[index] = p;
             break;
 
+        case MEMALIGN: /* posix_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if (posix_memalign((void **)&p, trace->ops[i].align, size) != 0)
+                unix_error("posix_memalign failed in eval_libc_speed");
+            trace->blocks[index] = p;
+            break;
+
         case REALLOC: /* realloc */
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
@@ -1224,9 +1731,90 @@ static void eval_libc_speed(void *ptr)
 
 
 /*
- * printresults - prints a performance summary for some malloc package
+ * printheapstats - prints the mm_stats() snapshots taken in the util
+ *     run: the heap at the payload peak, the coalesce cases and sbrk
+ *     calls over the whole run, and with -V the free blocks at the
+ *     peak by power-of-two size class
+ */
+static void printheapstats(int n, stats_t *stats)
+{
+    int i, j;
+    size_t fblocks;
+    mm_stats_t *p, *e;
+
+    printf("Heap at the payload peak, and coalesces and sbrks per trace:\n");
+    printf("%9s%9s%9s%9s%8s%9s%8s%8s%8s%7s  %s\n", "allocKB", "freeKB",
+           "parkKB", "maxfree", "fblocks", "coal1", "coal2", "coal3",
+           "coal4", "sbrks", "trace");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        p = &stats[i].peak;
+        e = &stats[i].end;
+        for (j = 0, fblocks = 0; j < MM_STATS_CLASSES; j++)
+            fblocks += p->free_blocks[j];
+        printf("%9zu%9zu%9zu%9zu%8zu%9zu%8zu%8zu%8zu%7zu  %s\n",
+               p->alloc_bytes / 1024, p->free_bytes / 1024, p->parked_bytes / 1024,
+               p->largest_free, fblocks, e->coalesces[0], e->coalesces[1],
+               e->coalesces[2], e->coalesces[3], e->sbrks,
+               stats[i].filename);
+        if (verbose > 1) {
+            printf("         ");
+            for (j = 0; j < MM_STATS_CLASSES; j++)
+                if (p->free_blocks[j] != 0)
+                    printf(" 2^%d:%zu", j, p->free_blocks[j]);
+            printf("\n");
+        }
+    }
+}
+
+/*
+ * printlatency - prints the percentiles of the cycles each kind of
+ *     request took, for each trace and then for all of them together
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    static const char *kind[LAT_KINDS] = { "malloc", "free", "realloc" };
+    static const double pct[] = { 0.5, 0.9, 0.99, 0.999 };
+    hist_t all[LAT_KINDS];
+    const hist_t *h;
+    int i, j, b, k;
+
+    memset(all, 0, sizeof(all));
+    printf("Cycles per request, less %llu cycles of timing overhead:\n",
+           lat_overhead);
+    printf("%8s%9s%8s%8s%8s%8s%10s  %s\n", "request", "count", "p50",
+           "p90", "p99", "p99.9", "max", "trace");
+    for (i = 0; i <= n; i++) {
+        if (i < n && !stats[i].valid)
+            continue;
+        for (j = 0; j < LAT_KINDS; j++) {
+            if (i < n) {
+                h = &stats[i].lat[j];
+                for (b = 0; b < LAT_BUCKETS; b++)
+                    all[j].count[b] += h->count[b];
+                all[j].n += h->n;
+                if (h->max > all[j].max)
+                    all[j].max = h->max;
+            }
+            else
+                h = &all[j];
+            if (h->n == 0)
+                continue;
+            printf("%8s%9lu", kind[j], h->n);
+            for (k = 0; k < 4; k++)
+                printf("%8llu", lat_percentile(h, pct[k]));
+            printf("%10llu  %s\n", h->max,
+                   i < n ? stats[i].filename : "all traces");
+        }
+    }
+}
+
+/*
+ * printresults - prints a performance summary for some malloc package,
+ *     with the heap and resident sizes and sbrk calls if mem is set
  */
-static void printresults(int n, stats_t *stats)
+static void printresults(int n, stats_t *stats, int mem)
 {
     int i;
     /* weighted sums all */
@@ -1239,8 +1827,12 @@ static void printresults(int n, stats_t *stats)
     char wstr;
 
     /* Print the individual results for each trace */
-    printf("  %2s%6s %5s%8s%9s  %s\n",
-           "valid", "util", "ops", "secs", "Kops", "trace");
+    printf("  %2s%6s %5s%8s%9s  ",
+           "valid", "util", "ops", "secs", "Kops");
+    if (mem)
+        printf("%8s%8s%7s%9s%9s ", "heapKB", "rssKB", "sbrks", "reallocs",
+               "stride");
+    printf("%s\n", "trace");
     for (i=0; i < n; i++) {
         if (stats[i].valid) {
             switch(stats[i].weight)
@@ -1282,6 +1874,10 @@ static void printresults(int n, stats_t *stats)
             else
                 printf("%8s%10s%6s", "--", "--", "--");
 
+            if (mem)
+                printf(" %8zu%7zu%7zu%9zu%9.0f", stats[i].heapsize / 1024,
+                       stats[i].resident / 1024, stats[i].sbrks,
+                       stats[i].reallocs, stats[i].stride);
             printf(" %s\n", stats[i].filename);
 
             if(stats[i].weight == WALL || stats[i].weight == WPERF)
@@ -1375,7 +1971,7 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
  */
 static void usage(void)
 {
-    fprintf(stderr, "Usage: mdriver [-hlVdD] [-f <file>]\n");
+    fprintf(stderr, "Usage: mdriver [-hlVdDrbzgSL] [-f <file>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
     fprintf(stderr, "\t-D         Equivalent to -d2.\n");
@@ -1387,4 +1983,11 @@ static void usage(void)
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-r         Report heap KB, resident KB, sbrk and realloc calls and\n");
+    fprintf(stderr, "\t           mean bytes between successive mallocs per trace.\n");
+    fprintf(stderr, "\t-b         Replay runs of same-size mallocs and of frees as batches.\n");
+    fprintf(stderr, "\t-z         Free with mm_free_sized(), passing the size from the trace.\n");
+    fprintf(stderr, "\t-g         Skip reallocs that fit in the block's mm_usable_size().\n");
+    fprintf(stderr, "\t-S         Print mm_stats() heap statistics per trace.\n");
+    fprintf(stderr, "\t-L         Time each request and print latency percentiles.\n");
 }
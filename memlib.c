@@ -3,6 +3,7 @@
  *						allows us to interleave calls from the student's malloc package 
  *						with the system's malloc package in libc.
  */
+#define _GNU_SOURCE			/* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -16,10 +17,33 @@
 #include "memlib.h"
 #include "config.h"
 
+/* Every mapping starts with one of these, hidden from the caller */
+typedef struct map {
+	struct map *next;			/* Neighbours on the list of live mappings */
+	struct map *prev;
+	size_t len;					/* Mapping length, header included */
+	size_t pad;					/* Keeps the caller's area 16-byte aligned */
+} map_t;
+
 /* private variables */
 static char *heap;
 static char *mem_brk;
 static char *mem_max_addr;
+static char *mem_fresh;			/* Heap from here up has never been handed out */
+static map_t *maps;				/* Live mappings */
+static size_t mapped;			/* Bytes in live mappings */
+static size_t peak;				/* Largest heap size plus mapped bytes so far */
+static size_t sbrks;			/* mem_sbrk calls so far */
+
+/*
+ * note_peak - update the footprint high-water mark
+ */
+static void note_peak(void) {
+	size_t now = (size_t)(mem_brk - heap) + mapped;
+
+	if (now > peak)
+		peak = now;
+}
 
 /* 
  * mem_init - initialize the memory system model
@@ -34,6 +58,7 @@ void mem_init(void){
 			0);						/* offset (dunno) */
 	mem_max_addr = heap + MAX_HEAP;
 	mem_brk = heap;					/* heap is empty initially */
+	mem_fresh = heap;
 }
 
 /* 
@@ -44,22 +69,43 @@ void mem_deinit(void){
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap,
+ *		and drop any mappings left over from the last run
  */
 void mem_reset_brk(){
 	mem_brk = heap;
+	while (maps != NULL)
+		mem_unmap((char *)maps + sizeof(map_t));
+	peak = 0;
+	sbrks = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *		by incr bytes and returns the start address of the new area. In
- *		this model, the heap cannot be shrunk.
+ *		by incr bytes and returns the start address of the new area. A
+ *		negative incr shrinks the heap instead, and the pages beyond the
+ *		new break go back to the system.
  */
 void *mem_sbrk(int incr) {
 	char *old_brk = mem_brk;
+	size_t page = mem_pagesize();
+
+	sbrks++;
+	if (incr < 0) {
+		if (mem_brk + incr < heap) {
+			errno = ENOMEM;
+			fprintf(stderr, "ERROR: mem_sbrk failed. Heap would be negative...\n");
+			return (void *)-1;
+		}
+		/* The real break may have moved since, so leave it be */
+		mem_brk += incr;
+		mem_release(mem_brk, (((size_t)old_brk + page - 1) & ~(page - 1)) -
+					(size_t)mem_brk);
+		return (void *)old_brk;
+	}
 
     // call sbrk() in an attempt to have similar semantics as a real allocator.
-	if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr) ||
+	if ( ((mem_brk + incr) > mem_max_addr) ||
             sbrk(incr) == (void *) -1) {
 		errno = ENOMEM;
 		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
@@ -67,9 +113,172 @@ void *mem_sbrk(int incr) {
 	}
 
 	mem_brk += incr;
+	if (mem_brk > mem_fresh)
+		mem_fresh = mem_brk;
+	note_peak();
 	return (void *)old_brk;
 }
 
+/*
+ * mem_release - model of madvise(MADV_DONTNEED): the whole pages in
+ *		p..p+size-1 go back to the system, and read as zero if touched
+ *		again.  Partial pages at either end are left alone.
+ */
+void mem_release(void *p, size_t size) {
+	size_t page = mem_pagesize();
+	char *lo = (char *)(((size_t)p + page - 1) & ~(page - 1));
+	char *hi = (char *)(((size_t)p + size) & ~(page - 1));
+
+	if (hi > lo) {
+		madvise(lo, hi - lo, MADV_DONTNEED);
+		if (lo < mem_fresh && hi >= mem_fresh)
+			mem_fresh = lo;
+	}
+}
+
+/*
+ * resident - count the resident bytes in the pages of lo..lo+len-1,
+ *		lo page-aligned
+ */
+static size_t resident(char *lo, size_t len) {
+	unsigned char vec[1024];
+	size_t page = mem_pagesize(), n = 0, chunk, i;
+
+	len = (len + page - 1) & ~(page - 1);
+	for (; len > 0; lo += chunk, len -= chunk) {
+		chunk = (len < sizeof(vec) * page) ? len : sizeof(vec) * page;
+		if (mincore(lo, chunk, vec) == 0)
+			for (i = 0; i < chunk / page; i++)
+				n += vec[i] & 1;
+	}
+	return n * page;
+}
+
+/*
+ * mem_resident - returns the number of bytes of the heap and of the
+ *		live mappings that are actually resident in memory
+ */
+size_t mem_resident() {
+	size_t n = resident(heap, (size_t)(mem_brk - heap));
+	map_t *m;
+
+	for (m = maps; m != NULL; m = m->next)
+		n += resident((char *)m, m->len);
+	return n;
+}
+
+/*
+ * mem_map - model of mmap for large blocks: returns a 16-byte aligned
+ *		area of at least size bytes in a fresh mapping of its own, or
+ *		(void *)-1.  The mapping lies outside the heap, and its pages go
+ *		back to the system as soon as it is unmapped.
+ */
+void *mem_map(size_t size) {
+	size_t len = (size + sizeof(map_t) + mem_pagesize() - 1) &
+		~(mem_pagesize() - 1);
+	map_t *m;
+
+	m = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+			 -1, 0);
+	if (m == MAP_FAILED) {
+		errno = ENOMEM;
+		return (void *)-1;
+	}
+	m->len = len;
+	m->prev = NULL;
+	m->next = maps;
+	if (maps != NULL)
+		maps->prev = m;
+	maps = m;
+	mapped += len;
+	note_peak();
+	return (char *)m + sizeof(map_t);
+}
+
+/*
+ * mem_remap - resize the mapping of area p, returned by mem_map, to
+ *		hold at least size bytes.  The pages move rather than being
+ *		copied, and the area may end up at a new address, which is
+ *		returned; on failure the old area is untouched and the result
+ *		is (void *)-1.
+ */
+void *mem_remap(void *p, size_t size) {
+	map_t *m = (map_t *)((char *)p - sizeof(map_t));
+	size_t len = (size + sizeof(map_t) + mem_pagesize() - 1) &
+		~(mem_pagesize() - 1);
+	size_t oldlen = m->len;
+
+	if (len == oldlen)
+		return p;
+	m = mremap(m, oldlen, len, MREMAP_MAYMOVE);
+	if (m == MAP_FAILED) {
+		errno = ENOMEM;
+		return (void *)-1;
+	}
+	m->len = len;
+	if (m->prev != NULL)
+		m->prev->next = m;
+	else
+		maps = m;
+	if (m->next != NULL)
+		m->next->prev = m;
+	mapped += len - oldlen;
+	note_peak();
+	return (char *)m + sizeof(map_t);
+}
+
+/*
+ * mem_unmap - return the mapping of area p, from mem_map, to the system
+ */
+void mem_unmap(void *p) {
+	map_t *m = (map_t *)((char *)p - sizeof(map_t));
+
+	if (m->prev != NULL)
+		m->prev->next = m->next;
+	else
+		maps = m->next;
+	if (m->next != NULL)
+		m->next->prev = m->prev;
+	mapped -= m->len;
+	munmap(m, m->len);
+}
+
+/*
+ * mem_mapped - return whether lo..hi lies within a single live mapping
+ */
+int mem_mapped(const void *lo, const void *hi) {
+	map_t *m;
+
+	for (m = maps; m != NULL; m = m->next)
+		if ((const char *)lo >= (char *)m + sizeof(map_t) &&
+			(const char *)hi < (char *)m + m->len)
+			return 1;
+	return 0;
+}
+
+/*
+ * mem_mapsize - returns the number of bytes in live mappings
+ */
+size_t mem_mapsize() {
+	return mapped;
+}
+
+/*
+ * mem_peak - returns the largest footprint so far, heap and mappings
+ *		together, since the last mem_reset_brk
+ */
+size_t mem_peak() {
+	return peak;
+}
+
+/*
+ * mem_sbrk_calls - returns the number of mem_sbrk calls since the last
+ *		mem_reset_brk, successful or not
+ */
+size_t mem_sbrk_calls() {
+	return sbrks;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -77,6 +286,16 @@ void *mem_heap_lo(){
 	return (void *)heap;
 }
 
+/*
+ * mem_heap_fresh - return the lowest address from which the heap has
+ *		never been handed out by mem_sbrk (or has been released since),
+ *		so that it still reads as zero.  mem_reset_brk leaves it alone:
+ *		the next run gets the old pages back as they are.
+ */
+void *mem_heap_fresh(){
+	return (void *)mem_fresh;
+}
+
 /* 
  * mem_heap_hi - return address of last heap byte
  */
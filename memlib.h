@@ -6,6 +6,17 @@ void *mem_sbrk(int incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
+void *mem_heap_fresh(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
+void mem_release(void *p, size_t size);
+size_t mem_resident(void);
+
+void *mem_map(size_t size);
+void *mem_remap(void *p, size_t size);
+void mem_unmap(void *p);
+int mem_mapped(const void *lo, const void *hi);
+size_t mem_mapsize(void);
+size_t mem_peak(void);
+size_t mem_sbrk_calls(void);
 
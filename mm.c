@@ -1,12 +1,45 @@
 /*
  * mm.c
- * 
+ *
  * Name: RedElephant Andrew Id: shiweid
  *
- * NOTE TO STUDENTS: Replace this header comment with your own header
- * comment that gives a high level description of your solution.
+ * Segregated-fit allocator with boundary tags.
+ *
+ * Blocks have a 4-byte header with the size, an allocated bit and a
+ * "previous block allocated" bit; only free blocks have a footer.  Free
+ * blocks are linked, by 32-bit heap offsets, into NUM_CLASSES lists by
+ * power-of-two size, or into a splay tree by size once they reach
+ * LARGE_MIN.  A bitmap of the non-empty lists lets malloc find the
+ * first usable class with one count-trailing-zeros; -DTLSF swaps this
+ * index for Two-Level Segregated Fit.  -DFIT picks how a list is
+ * searched and -DORDER whether it is kept LIFO or in address order.
+ *
+ * The free block at the top of the heap, the wilderness, is kept off
+ * the lists and serves only what nothing else fits, by bumping its
+ * start.  grow_heap() extends the heap by an adaptive step.
+ *
+ * Requests of at most SLAB_MAX bytes come from headerless slab pages.
+ * Freed blocks of at most QUICK_MAX bytes are parked uncoalesced on
+ * exact-size quick lists until a request misses or QUICK_LIMIT bytes
+ * are parked.  Requests of MMAP_MIN bytes or more get a mapping each.
+ * Big free blocks give their pages back: the top of the heap is
+ * trimmed past TRIM_MIN, and the inside of other free blocks past
+ * PURGE_MIN is released.  calloc() only clears memory below the
+ * arena's fresh mark, above which the heap has never been used.
+ *
+ * With -DTLSF malloc and free take constant time apart from system
+ * calls: the quick lists are compiled out, since consolidating them
+ * would coalesce many blocks in one call, and address order, which
+ * would make inserts walk a list, is refused.
+ *
+ * Building with -DTHREADS (without -DDRIVER, for interposition) keeps
+ * all of this state in up to MAX_ARENAS arenas, each behind its own
+ * lock, fronted by a per-thread cache of small blocks.  Blocks freed
+ * by a thread other than the arena's go onto its lock-free remote
+ * list, which is drained whenever the arena is locked.
  */
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,6 +47,11 @@
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
+
+#ifdef THREADS
+#include <pthread.h>
+#endif
 
 /* If you want debugging output, use the following macro.  When you hand
  * in, remove the #define DEBUG line. */
@@ -34,6 +72,15 @@
 #define calloc mm_calloc
 #endif /* def DRIVER */
 
+#ifdef DRIVER
+#define free_sized mm_free_sized
+#define memalign mm_memalign
+#define posix_memalign mm_posix_memalign
+#define aligned_alloc mm_aligned_alloc
+#define malloc_usable_size mm_usable_size
+#define malloc_good_size mm_good_size
+#endif
+
 /* single word (4) or double word (8) alignment */
 #define ALIGNMENT 8
 
@@ -44,9 +91,165 @@
 /* Basic constants and macros */
 #define WSIZE       4       /* Word and header/footer size (bytes) */ //line:vm:mm:beginconst
 #define DSIZE       8       /* Doubleword size (bytes) */
-#define CHUNKSIZE  (1<<12)  /* Extend heap by this amount (bytes) */  //line:vm:mm:endconst 
+#define CHUNKSIZE  (1<<12)  /* Extend heap by this amount (bytes) */  //line:vm:mm:endconst
+
+#define LSIZE       4       /* Free-list link size (bytes) */
+
+/* Smallest block: header, footer and two free-list links once freed */
+#define MIN_BLOCK   ALIGN(DSIZE + 2*LSIZE)
+
+/* Fit policies for the segregated lists; build with -DFIT=<one of
+ * these> (-DNEXT_FIT still means FIT_NEXT).  The policy is list_fit(),
+ * which searches one list. */
+#define FIT_FIRST   0       /* First block that fits */
+#define FIT_NEXT    1       /* First fit from where the list was last used */
+#define FIT_BEST    2       /* Smallest block that fits */
+#define FIT_BOUNDED 3       /* Smallest of the first FIT_K blocks that fit */
+#define FIT_ADDRESS 4       /* First fit, and ORDER_ADDRESS by default */
+#ifndef FIT
+#ifdef NEXT_FIT
+#define FIT         FIT_NEXT
+#else
+#define FIT         FIT_FIRST
+#endif
+#endif
+#ifndef FIT_K
+#define FIT_K       4       /* Candidates FIT_BOUNDED compares */
+#endif
+
+/* Free-list orders, for -DORDER=<one of these>; insert_free() keeps it */
+#define ORDER_LIFO    0     /* Freed blocks go to the front */
+#define ORDER_ADDRESS 1     /* Lists are sorted by address */
+#ifndef ORDER
+#if FIT == FIT_ADDRESS
+#define ORDER       ORDER_ADDRESS
+#else
+#define ORDER       ORDER_LIFO
+#endif
+#endif
+
+/* place() splits a block when at least SPLIT_MIN bytes would be left */
+#ifndef SPLIT_MIN
+#define SPLIT_MIN   MIN_BLOCK
+#endif
+
+#ifdef TLSF
+#define SL_LOG2     4       /* log2 of the second-level slices per row */
+#define SL_COUNT    (1 << SL_LOG2)
+#define FL_SHIFT    (SL_LOG2 + 3)  /* sizes below 1 << FL_SHIFT share row 0 */
+#define FL_COUNT    24      /* Rows: covers sizes up to 2^(FL_SHIFT+FL_COUNT-1) */
+#define NUM_LISTS   (FL_COUNT * SL_COUNT)
+#if FIT != FIT_FIRST
+#error "Fit policies do not apply to the TLSF index"
+#endif
+#if ORDER == ORDER_ADDRESS
+#error "Address order would make TLSF inserts walk their list"
+#endif
+#else
+#ifndef NUM_CLASSES
+#define NUM_CLASSES 8       /* Number of segregated free lists */
+#endif
+#if NUM_CLASSES > 32
+#error "NUM_CLASSES must fit in the unsigned int bin_map"
+#endif
+#define NUM_LISTS   NUM_CLASSES
+#define LARGE_MIN   ((1 << (NUM_CLASSES + 4)) + DSIZE)  /* Smallest tree block */
+#endif
+
+#ifndef SLAB_SHIFT
+#define SLAB_SHIFT  10      /* log2 of the slab page size */
+#endif
+#define SLAB_SIZE   (1 << SLAB_SHIFT)
+#define SLAB_MAX    64      /* Largest request served from a slab */
+#define SLAB_CLASSES 6      /* Number of slab object sizes */
+#define SLAB_WORDS  ((SLAB_SIZE/8 + 63) / 64)  /* Free-map words per page */
+
+/* shrink_block() keeps tails too small for any non-slab request */
+#define TAIL_MIN    ALIGN(SLAB_MAX + 1 + WSIZE)
 
-#define MAX(x, y) ((x) > (y)? (x) : (y))  
+#ifndef QUICK_MAX
+#define QUICK_MAX   128     /* Largest block parked on a quick list */
+#endif
+#define QUICK_BINS  ((int)(QUICK_MAX - TAIL_MIN)/8 + 1)  /* One per 8-byte size */
+#define QUICK_BIN(size) (((size) - TAIL_MIN) >> 3)
+#define QUICK_LIMIT (1<<12) /* Parked bytes that force a consolidation */
+#if QUICK_MAX > SLAB_MAX + 8*64
+#error "QUICK_MAX too big for the unsigned long quick_map"
+#endif
+
+#ifndef MMAP_MIN
+#define MMAP_MIN    (1<<17) /* Requests this big get their own mapping */
+#endif
+#define MAP_MAX     (0xffffffffUL - 2*DSIZE)  /* Must fit in a header */
+
+#ifndef TRIM_MIN
+#define TRIM_MIN    (1<<20) /* Free top block size that triggers a trim */
+#endif
+#ifndef TRIM_PAD
+#define TRIM_PAD    (TRIM_MIN/2)  /* Free space a trim leaves at the top */
+#endif
+#ifndef GROW_MAX
+#define GROW_MAX    (1<<20) /* Largest step the heap grows by */
+#endif
+#define GROW_FAST   32      /* Mallocs between growths that double the step */
+#define GROW_SLOW   1024    /* Mallocs between growths that halve it */
+#define GROW_FRAC   32      /* No step beyond 1/GROW_FRAC of the heap */
+
+#ifndef PURGE_MIN
+#define PURGE_MIN   (1<<20) /* Free blocks whose inner pages are released */
+#endif
+
+#ifndef PAD_ALIGN_MAX
+#define PAD_ALIGN_MAX 512   /* Largest alignment memalign pads rather than searches for */
+#endif
+
+#ifdef THREADS
+#ifndef TCACHE_MAX
+#define TCACHE_MAX  256     /* Largest request served from a thread cache */
+#endif
+#define TCACHE_BINS (TCACHE_MAX/8 + 1)  /* Bin c: usable size in [8c, 8c+8) */
+#define TCACHE_BATCH 16     /* Blocks moved per refill or flush */
+#define TCACHE_LIMIT (4*TCACHE_BATCH)  /* Bin size that triggers a flush */
+#ifndef MAX_ARENAS
+#define MAX_ARENAS  64      /* Upper bound on MM_ARENAS */
+#endif
+#if MAX_ARENAS > 256
+#error "MAX_ARENAS must fit in the unsigned char arena_of entries"
+#endif
+#define ARENA_GRAIN 4096    /* Chunks are multiples of this, and aligned */
+#define ARENA_CHUNK (1<<16) /* Smallest chunk an arena takes from memlib */
+#define CHUNK_HDR   24      /* Link, padding, prologue, epilogue */
+#define ARENA_SWITCH 8      /* Waits on the home lock before moving on */
+#define ARENA_OF(p) \
+    (&arenas[arena_of[((char *)(p) - (char *)mem_heap_lo()) / ARENA_GRAIN]])
+#define LOCK(a)     arena_lock(a)
+#define LOCK_HOME() home_lock()
+#define UNLOCK()    pthread_mutex_unlock(&arena->lock)
+#define MEM_LOCK()  pthread_mutex_lock(&sbrk_lock)
+#define MEM_UNLOCK() pthread_mutex_unlock(&sbrk_lock)
+#define SBRK(size)  arena_sbrk(size)
+#define RESERVE(size)  arena_reserve(size)
+#define CAN_GROW(bp, size) \
+    ((char *)(bp) == arena->brk && (size_t)(arena->end - arena->brk) >= (size))
+#define AT_TOP(bp)  (NEXT_BLKP(bp) == arena->brk)
+#define UNSBRK(size)  (arena->brk -= (size), release(arena->brk, size))
+#else
+#define MAX_ARENAS  1
+#define ARENA_OF(p) arena
+#define LOCK(a)
+#define LOCK_HOME()
+#define UNLOCK()
+#define MEM_LOCK()
+#define MEM_UNLOCK()
+#define SBRK(size)  mem_sbrk(size)
+#define RESERVE(size)  0
+#define CAN_GROW(bp, size)  1
+#define AT_TOP(bp)  (GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0)
+#define UNSBRK(size)  mem_sbrk(-(int)(size))
+#endif
+
+#define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) < (y)? (x) : (y))
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc)) //line:vm:mm:pack
@@ -59,125 +262,580 @@
 #define GET_SIZE(p)  (GET(p) & ~0x7)                   //line:vm:mm:getsize
 #define GET_ALLOC(p) (GET(p) & 0x1)                    //line:vm:mm:getalloc
 
+/* Header bit recording that the previous block is allocated */
+#define PREV_ALLOC        0x2
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+#define SET_PREV_ALLOC(p) PUT(p, GET(p) | PREV_ALLOC)
+#define CLR_PREV_ALLOC(p) PUT(p, GET(p) & ~PREV_ALLOC)
+
+/* Header bit of a block with a mapping of its own, and a test that
+ * needs only the pointer */
+#define MAPPED            0x4
+#define IS_MAPPED(p) \
+    ((size_t)((char *)(p) - (char *)mem_heap_lo()) >= MAX_HEAP)
+
+/* Free-block header bit recording that the pages inside it have been
+ * released; it is never set on allocated blocks, so it shares MAPPED */
+#define PURGED            0x4
+
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp)       ((char *)(bp) - WSIZE)                      //line:vm:mm:hdrp
 #define FTRP(bp)       ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE) //line:vm:mm:ftrp
 
-/* Given block ptr bp, compute address of next and previous blocks */
+/* Given block ptr bp, compute address of next and previous blocks.
+ * PREV_BLKP reads the previous block's footer, so it is only valid
+ * when that block is free. */
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE))) //line:vm:mm:nextblkp
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE))) //line:vm:mm:prevblkp
 
+/* Move the fresh mark past newly allocated block bp */
+#define NOTE_USED(bp) \
+    do { if (NEXT_BLKP(bp) > arena->fresh) arena->fresh = NEXT_BLKP(bp); } while (0)
+
+/* mm_stats() counts free blocks of 2^i to 2^(i+1)-1 bytes in class i */
+#define STAT_CLASS(size)  ((int)(8 * sizeof(long)) - 1 - __builtin_clzl(size))
+
+/* Free-list links are 32-bit offsets from heap_base, with 0 for NULL
+ * (offset 0 is the alignment padding, never a block) */
+#if MAX_HEAP > 0xffffffffUL
+#error "MAX_HEAP must fit in a 32-bit free-list link"
+#endif
+#define TO_LINK(p)   ((p) ? (unsigned int)((char *)(p) - heap_base) : 0)
+#define FROM_LINK(l) ((l) ? heap_base + (l) : NULL)
+
+/* Given free block ptr bp, read and write its free-list links */
+#define NEXT_FREE(bp)          FROM_LINK(GET(bp))
+#define PREV_FREE(bp)          FROM_LINK(GET((char *)(bp) + LSIZE))
+#define SET_NEXT_FREE(bp, p)   PUT(bp, TO_LINK(p))
+#define SET_PREV_FREE(bp, p)   PUT((char *)(bp) + LSIZE, TO_LINK(p))
+
+/* Given large free block ptr bp, read and write its tree children */
+#define LEFT(bp)               NEXT_FREE(bp)
+#define RIGHT(bp)              PREV_FREE(bp)
+#define SET_LEFT(bp, p)        SET_NEXT_FREE(bp, p)
+#define SET_RIGHT(bp, p)       SET_PREV_FREE(bp, p)
+
+/* Tree order: by size, then by address */
+#define KEY_LESS(size, addr, bp) \
+    ((size) < GET_SIZE(HDRP(bp)) || \
+     ((size) == GET_SIZE(HDRP(bp)) && (char *)(addr) < (char *)(bp)))
+#define KEY_GREATER(size, addr, bp) \
+    ((size) > GET_SIZE(HDRP(bp)) || \
+     ((size) == GET_SIZE(HDRP(bp)) && (char *)(addr) > (char *)(bp)))
+
+/* Header at the start of every slab page */
+typedef struct slab {
+    struct slab *next;         /* Neighbours on the partial list */
+    struct slab *prev;
+    unsigned int objsize;      /* Object size in bytes */
+    unsigned int nfree;        /* Number of free objects */
+    unsigned long freemap[SLAB_WORDS];  /* Bit set iff object is free */
+} slab_t;
+
+#ifdef THREADS
+/* Per-thread cache of free blocks, linked through their first word */
+typedef struct tcache {
+    void *bins[TCACHE_BINS];   /* LIFO chain per bin */
+    unsigned int count[TCACHE_BINS];
+    int live;                  /* Registered for the thread exit flush */
+} tcache_t;
+#endif
+
+#define SLAB_HDR       ALIGN(sizeof(slab_t))
+#define SLAB_INDEX(p)  (((char *)(p) - (char *)mem_heap_lo()) >> SLAB_SHIFT)
+#define SLAB_OFFSET(p) (((char *)(p) - (char *)mem_heap_lo()) & (SLAB_SIZE - 1))
+#define SLAB_NOBJS(s)  ((SLAB_SIZE - WSIZE - SLAB_HDR) / (s)->objsize)
+#ifdef THREADS
+/* Arenas update different bits of the same slab_pages word concurrently */
+#define SLAB_MARK(i)   __atomic_fetch_or(&slab_pages[(i) / 64], \
+                                         1UL << ((i) % 64), __ATOMIC_RELAXED)
+#define SLAB_UNMARK(i) __atomic_fetch_and(&slab_pages[(i) / 64], \
+                                          ~(1UL << ((i) % 64)), __ATOMIC_RELAXED)
+#else
+#define SLAB_MARK(i)   (slab_pages[(i) / 64] |= 1UL << ((i) % 64))
+#define SLAB_UNMARK(i) (slab_pages[(i) / 64] &= ~(1UL << ((i) % 64)))
+#endif
+
+/* Slab object sizes, and the class for each (size + 7) / 8 */
+static const unsigned int slab_sizes[SLAB_CLASSES] = { 8, 16, 24, 32, 48, 64 };
+static const unsigned char slab_class[SLAB_MAX/8 + 1] =
+    { 0, 0, 1, 2, 3, 4, 4, 5, 5 };
+
+/* Everything one heap needs; an arena is locked as a whole */
+typedef struct arena {
+    char *heap_listp;                 /* Pointer to first block */
+    slab_t *slab_partial[SLAB_CLASSES];  /* Pages with free objects */
+    char *seg_lists[NUM_LISTS];       /* Heads of the segregated free lists */
+    char *quick[QUICK_BINS];          /* Parked blocks, one LIFO per size */
+    unsigned long quick_map;          /* Bit q set iff quick[q] non-empty */
+    size_t quick_bytes;               /* Total size of the parked blocks */
+    char *fresh;                      /* No block from here up was ever used */
+    char *wild;                       /* Free top block, kept off the lists */
+    size_t heapsize;                  /* Bytes of heap, trims deducted */
+    size_t grow;                      /* Step the heap grows by next */
+    unsigned long mallocs;            /* heap_malloc calls so far */
+    unsigned long grown_at;           /* ... when the heap last grew */
+    size_t free_bytes;                /* Bytes on the free lists and tree */
+    size_t free_blocks[MM_STATS_CLASSES];  /* ... blocks, by STAT_CLASS */
+    size_t coalesces[4];              /* coalesce() calls by case */
+#ifdef TLSF
+    unsigned int fl_map;              /* Bit f set iff row f has a non-empty list */
+    unsigned int sl_map[FL_COUNT];    /* Bit s set iff list (f, s) non-empty */
+#else
+    unsigned int bin_map;             /* Bit i set iff seg_lists[i] non-empty */
+    char *tree_root;                  /* Splay tree of large free blocks */
+#endif
+#if FIT == FIT_NEXT
+    char *rover[NUM_CLASSES];         /* Next fit rover for each list */
+#endif
+#ifdef THREADS
+    pthread_mutex_t lock;
+    char *chunks;                     /* Newest chunk; they link through word 0 */
+    char *brk;                        /* Top of the newest chunk's heap */
+    char *end;                        /* End of the newest chunk */
+    void *remote;                     /* Blocks freed by other threads */
+#endif
+} arena_t;
+
 /* Global variables */
-static char *heap_listp = 0;  /* Pointer to first block */  
-#ifdef NEXT_FIT
-static char *rover;           /* Next fit rover */
+static char *heap_base;               /* mem_heap_lo(), the link origin */
+static arena_t arenas[MAX_ARENAS];
+static unsigned long slab_pages[MAX_HEAP / SLAB_SIZE / 64]; /* Slab windows */
+#ifdef THREADS
+static int narenas;                   /* Arenas in use, from MM_ARENAS */
+static unsigned int next_arena;       /* Round-robin assignment counter */
+static unsigned char arena_of[MAX_HEAP / ARENA_GRAIN];  /* Owner per grain */
+static pthread_mutex_t sbrk_lock = PTHREAD_MUTEX_INITIALIZER;  /* memlib */
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tcache_key;      /* Runs tcache_exit at thread exit */
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+#define TLS __thread __attribute__((tls_model("initial-exec")))
+static TLS tcache_t tcache;
+static TLS arena_t *arena;            /* The arena this thread has locked */
+static TLS arena_t *home;             /* The arena this thread allocates from */
+static TLS unsigned int contended;    /* Lock waits on home since last move */
+#else
+static arena_t *const arena = &arenas[0];
 #endif
 
 /*Function prototypes for internal help routines*/
 static void *extend_heap(size_t words);
+static void *grow_heap(size_t asize);
+static size_t grow_step(size_t need);
+static void *wild_alloc(size_t asize);
 static void *coalesce(void* bp);
 static void place(void* bp, size_t asize);
+static void heap_free_block(void *bp);
+static void free_block(void *bp);
+static void release_free(char *bp, char *lo, char *hi);
+static size_t carve(char *bp, size_t asize, size_t n, void **out);
+#ifndef TLSF
+static void quick_push(void *bp, size_t size);
+#endif
+static void *quick_pop(size_t asize);
+static int quick_consolidate(void);
+static void shrink_block(void *bp, size_t asize);
+static void *alloc_aligned(size_t align, size_t asize);
+static void *alloc_padded(size_t align, size_t asize);
+static int is_slab(const void *p);
+static void *slab_alloc(size_t size);
+static void slab_free(void *p);
+static void checkslab(slab_t *s);
+static size_t usable_size(void *bp);
 static void *find_fit(size_t asize);
+static int size_class(size_t size);
+static int list_marked(int i);
+static void insert_free(void *bp);
+static void remove_free(void *bp);
+#ifndef TLSF
+static char *list_fit(int i, size_t asize);
+static char *splay(char *t, size_t size, const char *addr);
+static void tree_insert(char *bp);
+static void tree_remove(char *bp);
+static void *tree_best_fit(size_t asize);
+static size_t checktree(char *t, char **last);
+#endif
+#ifdef THREADS
+static void remote_push(arena_t *a, void *first, void *last);
+static void tcache_exit(void *arg);
+#endif
+static size_t checkchunk(char *bp, int verbose);
+static void checkarena(int verbose);
 static void printblock(void* bp);
 static void checkblock(void* bp);
 
 /*
- * Initialize: return -1 on error, 0 on success.
+ * Initialize: return -1 on error, 0 on success.  With -DTHREADS this
+ * sets up the calling thread's current arena, and heap_malloc() calls
+ * it with the arena locked the first time the arena is used.
  */
 int mm_init(void) {
+    int i;
+
+#ifdef THREADS
+    /* The first chunk brings the prologue along */
+    arena->heap_listp = arena->chunks = NULL;
+    arena->brk = arena->end = NULL;
+    arena->fresh = heap_base;         /* memlib never reuses heap here */
+#else
+#ifndef DRIVER
+    if (mem_heap_lo() == NULL)
+        mem_init();
+#endif
+
     /* Create the initial empty heap */
-    if ((heap_listp = mem_sbrk(4*WSIZE)) == (void *)-1) //line:vm:mm:begininit
+    arena->fresh = mem_heap_fresh();
+    if ((arena->heap_listp = mem_sbrk(4*WSIZE)) == (void *)-1) //line:vm:mm:begininit
         return -1;
-    PUT(heap_listp, 0);                          /* Alignment padding */
-    PUT(heap_listp + (1*WSIZE), PACK(DSIZE, 1)); /* Prologue header */ 
-    PUT(heap_listp + (2*WSIZE), PACK(DSIZE, 1)); /* Prologue footer */ 
-    PUT(heap_listp + (3*WSIZE), PACK(0, 1));     /* Epilogue header */
-    heap_listp += (2*WSIZE);                     //line:vm:mm:endinit  
+    PUT(arena->heap_listp, 0);                          /* Alignment padding */
+    PUT(arena->heap_listp + (1*WSIZE), PACK(DSIZE, PREV_ALLOC | 1)); /* Prologue header */
+    PUT(arena->heap_listp + (2*WSIZE), PACK(DSIZE, PREV_ALLOC | 1)); /* Prologue footer */
+    PUT(arena->heap_listp + (3*WSIZE), PACK(0, PREV_ALLOC | 1)); /* Epilogue header */
+    arena->heap_listp += (2*WSIZE);                     //line:vm:mm:endinit
+    heap_base = mem_heap_lo();
+    memset(slab_pages, 0, sizeof(slab_pages));
+#endif
 
-#ifdef NEXT_FIT
-    rover = heap_listp;
+#ifdef TLSF
+    arena->fl_map = 0;
+    for (i = 0; i < FL_COUNT; i++)
+        arena->sl_map[i] = 0;
+#else
+    arena->bin_map = 0;
+    arena->tree_root = NULL;
+#endif
+    for (i = 0; i < NUM_LISTS; i++) {
+        arena->seg_lists[i] = NULL;
+#if FIT == FIT_NEXT
+        arena->rover[i] = NULL;
 #endif
+    }
+    for (i = 0; i < SLAB_CLASSES; i++)
+        arena->slab_partial[i] = NULL;
+    for (i = 0; i < QUICK_BINS; i++)
+        arena->quick[i] = NULL;
+    arena->quick_map = 0;
+    arena->quick_bytes = 0;
+    arena->wild = NULL;
+    arena->heapsize = 0;
+    arena->grow = CHUNKSIZE;
+    arena->mallocs = arena->grown_at = 0;
+    arena->free_bytes = 0;
+    memset(arena->free_blocks, 0, sizeof(arena->free_blocks));
+    memset(arena->coalesces, 0, sizeof(arena->coalesces));
 
     /* Extend the empty heap with a free block of CHUNKSIZE bytes */
-    if (extend_heap(CHUNKSIZE/WSIZE) == NULL) 
+    if (extend_heap(CHUNKSIZE/WSIZE) == NULL)
         return -1;
 
     return 0;
 }
 
 /*
- * malloc
+ * heap_malloc - malloc proper, run with the current arena locked
  */
-void *malloc (size_t size) {
+static void *heap_malloc(size_t size) {
     size_t asize;      /* Adjusted block size */
-    size_t extendsize; /* Amount to extend heap if no fit */
-    char *bp;      
+    char *bp;
 
-    if (heap_listp == 0){
+    if (arena->heap_listp == 0){
         mm_init();
     }
 
-    /* Ignore spurious requests */
-    if (size == 0)
+    /* Ignore spurious requests in the driver.  Programs expect a
+     * unique block they can free, so they get the smallest there is. */
+    if (size == 0) {
+#ifdef DRIVER
         return NULL;
+#else
+        size = 1;
+#endif
+    }
+    arena->mallocs++;
 
-    /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= DSIZE)                     
-        asize = 2*DSIZE;                  
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
+    if (size <= SLAB_MAX)
+        return slab_alloc(size);
+
+    /* Adjust block size to include the header and alignment reqs. */
+    asize = MAX(MIN_BLOCK, ALIGN(size + WSIZE));
+
+    /* A parked block of exactly this size needs no search or split */
+    if (asize <= QUICK_MAX && (bp = quick_pop(asize)) != NULL)
+        return bp;
 
-    /* Search the free list for a fit */
-    if ((bp = find_fit(asize)) != NULL) { 
-        place(bp, asize);                
+    /* Search the free lists for a fit, coalescing the parked blocks
+     * before giving up */
+    if ((bp = find_fit(asize)) != NULL ||
+        (quick_consolidate() && (bp = find_fit(asize)) != NULL)) {
+        place(bp, asize);
         return bp;
     }
 
-    /* No fit found. Get more memory and place the block */
-    extendsize = MAX(asize,CHUNKSIZE);  
-    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)  
-        return NULL;                   
-    place(bp, asize);                 
-    return bp;
+    /* No fit found.  Carve the block off the wilderness, growing the
+     * heap first if even that is too small */
+    if ((arena->wild == NULL || GET_SIZE(HDRP(arena->wild)) < asize) &&
+        grow_heap(asize) == NULL)
+        return NULL;
+    return wild_alloc(asize);
 }
 
 /*
- * free
+ * heap_free - free proper, run with the current arena locked
  */
-void free (void *ptr) {
-    if(ptr == 0) 
+static void heap_free(void *ptr) {
+    if(ptr == 0)
+        return;
+
+    if (is_slab(ptr)) {
+        slab_free(ptr);
         return;
+    }
+    heap_free_block(ptr);
+}
 
-    size_t size = GET_SIZE(HDRP(ptr));
+/*
+ * heap_free_block - heap_free() for a block that is known not to be a
+ *     slab object
+ */
+static void heap_free_block(void *bp) {
+#ifndef TLSF
+    size_t size = GET_SIZE(HDRP(bp));
+#endif
 
-    if (heap_listp == 0){
+    if (arena->heap_listp == 0){
         mm_init();
     }
 
-    PUT(HDRP(ptr), PACK(size, 0));
-    PUT(FTRP(ptr), PACK(size, 0));
-    coalesce(ptr);
+#ifndef TLSF
+    if (size >= TAIL_MIN && size <= QUICK_MAX) {
+        quick_push(bp, size);
+        return;
+    }
+#endif
+    free_block(bp);
 }
 
 /*
- * realloc - you may want to look at mm-naive.c
+ * free_block - Mark allocated block bp free, coalesce it and give big
+ *     free blocks back to the system
  */
-void *realloc(void *oldptr, size_t size) {
-    size_t oldsize;
+static void free_block(void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    char *next = NEXT_BLKP(bp);
+    char *lo = bp, *hi = next;    /* Range whose pages may be resident */
+    int bury = !GET_ALLOC(HDRP(next)) && next >= arena->fresh;
+
+    /* Purged neighbours add nothing to it */
+    if (!GET_PREV_ALLOC(HDRP(bp)) && !(GET((char *)bp - DSIZE) & PURGED))
+        lo = PREV_BLKP(bp);
+    if (!GET_ALLOC(HDRP(next)) && !(GET(HDRP(next)) & PURGED))
+        hi = NEXT_BLKP(next);
+
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), GET(HDRP(bp)));
+    CLR_PREV_ALLOC(HDRP(next));
+    bp = coalesce(bp);
+
+    /* Links that end up inside the merged block must not show through
+     * the fresh part of the heap */
+    if (bury) {
+        PUT(next, 0);
+        PUT(next + LSIZE, 0);
+    }
+    release_free(bp, lo, hi);
+}
+
+/*
+ * release - mem_release() under the memlib lock, since it also moves
+ *     memlib's fresh mark, which mem_sbrk() updates
+ */
+static void release(void *p, size_t size) {
+    MEM_LOCK();
+    mem_release(p, size);
+    MEM_UNLOCK();
+}
+
+/*
+ * release_free - Hand the memory of newly coalesced free block bp back
+ *     to the system when it is big: trim the heap if bp is its top
+ *     block, and otherwise release the pages of lo..hi, the part of bp
+ *     that was not purged before, once that part is PURGE_MIN bytes
+ */
+static void release_free(char *bp, char *lo, char *hi) {
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (size >= TRIM_MIN && AT_TOP(bp)) {
+        remove_free(bp);
+        PUT(FTRP(bp), 0);         /* Its page may not be released */
+        UNSBRK(size - TRIM_PAD);
+        arena->heapsize -= size - TRIM_PAD;
+        PUT(HDRP(bp), PACK(TRIM_PAD, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(TRIM_PAD, PREV_ALLOC));
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+        insert_free(bp);
+        return;
+    }
+    if (size < PURGE_MIN)
+        return;
+
+    /* Never release the links or the footer */
+    if (hi - lo >= PURGE_MIN) {
+        if (lo < bp + 2*LSIZE)
+            lo = bp + 2*LSIZE;
+        if (hi > FTRP(bp))
+            hi = FTRP(bp);
+        release(lo, hi - lo);
+    }
+    PUT(HDRP(bp), GET(HDRP(bp)) | PURGED);
+    PUT(FTRP(bp), GET(HDRP(bp)));
+}
+
+#ifndef TLSF
+/*
+ * quick_push - Park allocated block bp of size bytes on its quick
+ *     list, consolidating once more than QUICK_LIMIT bytes are parked
+ */
+static void quick_push(void *bp, size_t size) {
+    int q = QUICK_BIN(size);
+
+    SET_NEXT_FREE(bp, arena->quick[q]);
+    arena->quick[q] = bp;
+    arena->quick_map |= 1UL << q;
+    if ((arena->quick_bytes += size) > QUICK_LIMIT)
+        quick_consolidate();
+}
+
+/*
+ * quick_pop - Take a parked block of exactly asize bytes, or NULL
+ */
+static void *quick_pop(size_t asize) {
+    int q = QUICK_BIN(asize);
+    char *bp = arena->quick[q];
+
+    if (bp == NULL)
+        return NULL;
+    if ((arena->quick[q] = NEXT_FREE(bp)) == NULL)
+        arena->quick_map &= ~(1UL << q);
+    arena->quick_bytes -= asize;
+    return bp;
+}
+
+/*
+ * quick_consolidate - Free and coalesce every parked block.  Returns
+ *     whether there were any.
+ */
+static int quick_consolidate(void) {
+    unsigned long map = arena->quick_map;
+    char *bp, *next;
+    int q;
+
+    if (map == 0)
+        return 0;
+    for (; map != 0; map &= map - 1) {
+        q = __builtin_ctzl(map);
+        for (bp = arena->quick[q]; bp != NULL; bp = next) {
+            next = NEXT_FREE(bp);
+            free_block(bp);
+        }
+        arena->quick[q] = NULL;
+    }
+    arena->quick_map = 0;
+    arena->quick_bytes = 0;
+    return 1;
+}
+#else
+/*
+ * quick_pop, quick_consolidate - TLSF parks nothing, since consolidating
+ *     would coalesce an unbounded number of blocks in one call
+ */
+static void *quick_pop(size_t asize __attribute__((unused))) {
+    return NULL;
+}
+
+static int quick_consolidate(void) {
+    return 0;
+}
+#endif
+
+/*
+ * heap_realloc - Resize in place whenever the neighbourhood allows it:
+ *     shrinking splits the tail off as a free block, and growing
+ *     absorbs a free successor and/or extends the heap when the block
+ *     is the last one.  Only otherwise do we fall back to malloc,
+ *     memcpy and free.  Run with the current arena locked.
+ */
+static void *heap_realloc(void *oldptr, size_t size) {
+    size_t oldsize, asize, csize, avail;
     void *newptr;
+    char *next;
 
     /* If size == 0 then this is just free, and we return NULL. */
     if(size == 0) {
-        free(oldptr);
+        heap_free(oldptr);
         return 0;
     }
 
     /* If oldptr is NULL, then this is just malloc. */
     if(oldptr == NULL) {
-        return malloc(size);
+        return heap_malloc(size);
+    }
+
+    /* Slab objects stay put while the new size still fits */
+    if (is_slab(oldptr)) {
+        oldsize = ((slab_t *)((char *)oldptr - SLAB_OFFSET(oldptr)))->objsize;
+        if (size <= oldsize)
+            return oldptr;
+        if ((newptr = heap_malloc(size)) == NULL)
+            return 0;
+        memcpy(newptr, oldptr, oldsize);
+        slab_free(oldptr);
+        return newptr;
     }
 
-    newptr = malloc(size);
+    asize = MAX(MIN_BLOCK, ALIGN(size + WSIZE));
+    csize = GET_SIZE(HDRP(oldptr));
+
+    /* Shrinking (or staying put): give back the tail */
+    if (asize <= csize) {
+        shrink_block(oldptr, asize);
+        return oldptr;
+    }
+
+    /* Growing: count the free successor and, if the block is the last
+     * one before the epilogue, grow the heap by at least the deficit.
+     * A block that keeps growing at the top would otherwise cost a
+     * mem_sbrk() per realloc, so it takes grow_step(), and the surplus
+     * goes back as the wilderness. */
+    next = NEXT_BLKP(oldptr);
+    avail = csize;
+    if (!GET_ALLOC(HDRP(next))) {
+        avail += GET_SIZE(HDRP(next));
+        next = NEXT_BLKP(next);
+    }
+    if (avail < asize && GET_SIZE(HDRP(next)) == 0) {
+        size_t deficit = MAX(asize - avail, MIN_BLOCK);
+        size_t step = grow_step(deficit);
+
+        if (!CAN_GROW(next, step))
+            step = deficit;
+        if (CAN_GROW(next, step)) {
+            if (extend_heap(step/WSIZE) == NULL)
+                return 0;
+            avail += step;
+        }
+    }
+    if (avail >= asize) {
+        next = NEXT_BLKP(oldptr);
+        remove_free(next);
+        PUT(HDRP(oldptr), PACK(csize + GET_SIZE(HDRP(next)),
+                               GET_PREV_ALLOC(HDRP(oldptr)) | 1));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(oldptr)));
+        shrink_block(oldptr, asize);
+        NOTE_USED(oldptr);
+        return oldptr;
+    }
+
+    newptr = heap_malloc(size);
 
     /* If realloc() fails the original block is left untouched  */
     if(!newptr) {
@@ -185,212 +843,1920 @@ void *realloc(void *oldptr, size_t size) {
     }
 
     /* Copy the old data. */
-    oldsize = GET_SIZE(HDRP(oldptr));
+    oldsize = csize - WSIZE;
     if(size < oldsize) oldsize = size;
     memcpy(newptr, oldptr, oldsize);
 
     /* Free the old block. */
-    free(oldptr);
+    heap_free(oldptr);
 
     return newptr;
 }
 
 /*
- * calloc - you may want to look at mm-naive.c
- * This function is not tested by mdriver, but it is
- * needed to run the traces.
+ * heap_malloc_batch - Allocate up to n blocks of size bytes into out
+ *     and return how many were allocated, run with the current arena
+ *     locked.  Each free block that is found is carved into as many
+ *     of them as it holds, and when nothing fits the wilderness is
+ *     grown once for all that are left.
  */
-void *calloc (size_t nmemb, size_t size) {
-  size_t bytes = nmemb * size;
-  void *newptr;
+static size_t heap_malloc_batch(size_t size, size_t n, void **out) {
+    size_t asize, want, i = 0;
+    char *bp;
+
+    if (arena->heap_listp == 0){
+        mm_init();
+    }
 
-  newptr = malloc(bytes);
-  memset(newptr, 0, bytes);
+    if (size == 0)
+        return 0;
+    if (size <= SLAB_MAX) {
+        while (i < n && (out[i] = heap_malloc(size)) != NULL)
+            i++;
+        return i;
+    }
 
-  return newptr;
+    asize = MAX(MIN_BLOCK, ALIGN(size + WSIZE));
+    while (i < n) {
+        if (asize <= QUICK_MAX && (bp = quick_pop(asize)) != NULL) {
+            arena->mallocs++;
+            out[i++] = bp;
+            continue;
+        }
+        if ((bp = find_fit(asize)) == NULL &&
+            (!quick_consolidate() || (bp = find_fit(asize)) == NULL)) {
+            want = MIN(n - i, MAX_HEAP / asize) * asize;
+            if ((arena->wild == NULL || GET_SIZE(HDRP(arena->wild)) < want) &&
+                grow_heap(want) == NULL &&
+                (arena->wild == NULL || GET_SIZE(HDRP(arena->wild)) < asize))
+                break;
+            bp = arena->wild;
+        }
+        i += carve(bp, asize, n - i, out + i);
+    }
+    return i;
 }
 
+/*
+ * carve - Split free block bp, which holds at least asize bytes, into
+ *     up to n allocated blocks of asize bytes, stored in out, and
+ *     return how many.  The rest of bp stays free; a rest too small
+ *     for a block goes to the last one.
+ */
+static size_t carve(char *bp, size_t asize, size_t n, void **out) {
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t purged = GET(HDRP(bp)) & PURGED;   /* Still true of the rest */
+    size_t i, k = MIN(n, csize / asize);
+
+    remove_free(bp);
+    for (i = 0; i < k; i++) {
+        PUT(HDRP(bp), PACK(asize, PREV_ALLOC | 1));
+        out[i] = bp;
+        bp += asize;
+    }
+    csize -= k * asize;
+
+    if (csize >= MIN_BLOCK) {
+        PUT(HDRP(bp), PACK(csize, PREV_ALLOC | purged));
+        PUT(FTRP(bp), PACK(csize, PREV_ALLOC | purged));
+        insert_free(bp);
+    }
+    else {
+        PUT(HDRP(out[k-1]), PACK(asize + csize, PREV_ALLOC | 1));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(out[k-1])));
+    }
+    NOTE_USED(out[k-1]);
+    arena->mallocs += k;
+    return k;
+}
 
 /*
- * Return whether the pointer is in the heap.
- * May be useful for debugging.
+ * heap_free_run - Free ptrs[i] together with the blocks that follow it
+ *     both in the heap and in ptrs, and return the index of the first
+ *     pointer left.  A run of neighbours is made
+ *     into a single allocated block first, so it is coalesced, and its
+ *     pages released, once.  Run with the owning arena locked.
  */
-static int in_heap(const void *p) {
-    return p <= mem_heap_hi() && p >= mem_heap_lo();
+static size_t heap_free_run(void **ptrs, size_t i, size_t n) {
+    char *bp = ptrs[i];
+    size_t size;
+
+    if (is_slab(bp)) {
+        slab_free(bp);
+        return i + 1;
+    }
+
+    size = GET_SIZE(HDRP(bp));
+    for (i++; i < n && (char *)ptrs[i] == bp + size; i++)
+        size += GET_SIZE(HDRP(ptrs[i]));
+    if (size == GET_SIZE(HDRP(bp)))
+        heap_free(bp);
+    else {
+        PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)) | 1));
+        free_block(bp);
+    }
+    return i;
 }
 
+#ifdef THREADS
 /*
- * Return whether the pointer is aligned.
- * May be useful for debugging.
+ * arenas_init - One-time setup: map the heap and decide how many
+ *     arenas to use (MM_ARENAS, or twice the number of CPUs)
  */
-static int aligned(const void *p) {
-    return (size_t)ALIGN(p) == (size_t)p;
+static void arenas_init(void) {
+    char *env = getenv("MM_ARENAS");
+    long n = env ? atol(env) : 2 * sysconf(_SC_NPROCESSORS_ONLN);
+    int i;
+
+    mem_init();
+    heap_base = mem_heap_lo();
+    narenas = n < 1 ? 1 : n > MAX_ARENAS ? MAX_ARENAS : n;
+    for (i = 0; i < MAX_ARENAS; i++)
+        pthread_mutex_init(&arenas[i].lock, NULL);
 }
 
 /*
- * mm_checkheap
+ * home_arena - The arena the calling thread allocates from; threads
+ *     are handed out to arenas round-robin on first use
  */
-void mm_checkheap(int verbose) {
-    char *bp = heap_listp;
+static arena_t *home_arena(void) {
+    if (home == NULL) {
+        pthread_once(&arena_once, arenas_init);
+        home = &arenas[__atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED)
+                       % narenas];
+    }
+    return home;
+}
 
-    if (verbose)
-        printf("Heap (%p):\n", heap_listp);
+/*
+ * remote_push - Push the chain of blocks from first to last onto the
+ *     remote list of arena a.  Blocks are only ever taken off by a
+ *     thread holding a's lock, which takes them all at once, so there
+ *     is no ABA problem.
+ */
+static void remote_push(arena_t *a, void *first, void *last) {
+    void *head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
 
-    if ((GET_SIZE(HDRP(heap_listp)) != DSIZE) || !GET_ALLOC(HDRP(heap_listp)))
-        printf("Bad prologue header\n");
-    checkblock(heap_listp);
+    do {
+        *(void **)last = head;
+    } while (!__atomic_compare_exchange_n(&a->remote, &head, first, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
 
-    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
-        if (verbose) 
-            printblock(bp);
-        checkblock(bp);
-    }
+/*
+ * remote_drain - Free every block on the current arena's remote list
+ */
+static void remote_drain(void) {
+    void *bp, *next;
 
-    if (verbose)
-        printblock(bp);
-    if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
-        printf("Bad epilogue header\n");
+    if (__atomic_load_n(&arena->remote, __ATOMIC_RELAXED) == NULL)
+        return;
+    bp = __atomic_exchange_n(&arena->remote, NULL, __ATOMIC_ACQUIRE);
+    for (; bp != NULL; bp = next) {
+        next = *(void **)bp;
+        heap_free(bp);
+    }
+}
 
-    in_heap(heap_listp);
-    aligned(heap_listp);
+/*
+ * arena_lock - Lock arena a, make it the current one and drain its
+ *     remote list.  Any thread that locks an arena drains it, so that
+ *     blocks freed into an arena whose threads have all exited or moved
+ *     on are not lost.
+ */
+static void arena_lock(arena_t *a) {
+    pthread_mutex_lock(&a->lock);
+    arena = a;
+    remote_drain();
 }
 
 /*
- * Extend heap with free blocks and return its block pointer
+ * home_lock - Lock the calling thread's home arena, make it the
+ *     current one and drain its remote list.  A thread that has to
+ *     wait for its home arena ARENA_SWITCH times moves its home to the
+ *     next arena.
  */
-static void *extend_heap(size_t words){
-    char *bp;
-    size_t size;
+static void home_lock(void) {
+    arena_t *a = home_arena();
 
-    /*Allocate an even number of words to maintain alignments*/
-    size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
-    if((long)(bp = mem_sbrk(size)) == -1)
-        return NULL;
+    if (pthread_mutex_trylock(&a->lock) != 0) {
+        if (narenas > 1 && ++contended >= ARENA_SWITCH) {
+            contended = 0;
+            home = a = &arenas[(a - arenas + 1) % narenas];
+        }
+        pthread_mutex_lock(&a->lock);
+    }
+    arena = a;
+    remote_drain();
+}
 
-    /*Intialize free block header/footer and the epilogue header*/
-    PUT(HDRP(bp), PACK(size, 0)); /*Free block header*/ 
-    PUT(FTRP(bp), PACK(size, 0)); /*Free block Footer*/ 
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /*The new epilogue block*/ 
+/*
+ * arena_reserve - Make sure the current arena's newest chunk has room
+ *     for size more bytes, taking a new chunk from memlib if it has
+ *     not.  A new chunk that happens to follow the old one just makes
+ *     it longer; otherwise it starts with its own prologue and
+ *     epilogue, the rest of the old chunk goes unused, and the old
+ *     wilderness joins the free lists.
+ */
+static int arena_reserve(size_t size) {
+    size_t csize;
+    char *c, *w;
 
-    /*Coalasce if the previous block is free*/ 
-    return coalesce(bp);
-}
+    if ((size_t)(arena->end - arena->brk) >= size)
+        return 0;
 
-static void* coalesce(void *bp) {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
-    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
-    size_t size = GET_SIZE(HDRP(bp));
+    csize = (size + CHUNK_HDR + ARENA_GRAIN - 1) & ~(size_t)(ARENA_GRAIN - 1);
+    csize = MAX(csize, ARENA_CHUNK);
+    pthread_mutex_lock(&sbrk_lock);
+    if ((c = mem_sbrk(csize)) != (void *)-1)
+        memset(&arena_of[(c - (char *)mem_heap_lo()) / ARENA_GRAIN],
+               arena - arenas, csize / ARENA_GRAIN);
+    pthread_mutex_unlock(&sbrk_lock);
+    if (c == (void *)-1)
+        return -1;
 
-    if (prev_alloc && next_alloc) {            /* Case 1 */
-        return bp;
+    if (c == arena->end) {
+        arena->end += csize;
+        return 0;
     }
 
-    else if (prev_alloc && !next_alloc) {      /* Case 2 */
-        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(FTRP(bp), PACK(size,0));
+    *(char **)c = arena->chunks;
+    arena->chunks = c;
+    PUT(c + 2*WSIZE, 0);                                /* Alignment padding */
+    PUT(c + 3*WSIZE, PACK(DSIZE, PREV_ALLOC | 1));      /* Prologue header */
+    PUT(c + 4*WSIZE, PACK(DSIZE, PREV_ALLOC | 1));      /* Prologue footer */
+    PUT(c + 5*WSIZE, PACK(0, PREV_ALLOC | 1));          /* Epilogue header */
+    if (arena->heap_listp == NULL)
+        arena->heap_listp = c + 4*WSIZE;
+    arena->brk = c + CHUNK_HDR;
+    arena->end = c + csize;
+
+    /* The old wilderness is not at the top any more */
+    if ((w = arena->wild) != NULL) {
+        arena->wild = NULL;
+        insert_free(w);
     }
+    return 0;
+}
 
-    else if (!prev_alloc && next_alloc) {      /* Case 3 */
-        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-        PUT(FTRP(bp), PACK(size, 0));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        bp = PREV_BLKP(bp);
-    }
+/*
+ * arena_sbrk - mem_sbrk for the current arena
+ */
+static void *arena_sbrk(size_t size) {
+    char *old;
+
+    if (arena_reserve(size) < 0)
+        return (void *)-1;
+    old = arena->brk;
+    arena->brk += size;
+    return old;
+}
 
-    else {                                     /* Case 4 */
-        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + 
-            GET_SIZE(FTRP(NEXT_BLKP(bp)));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
+/*
+ * tcache_key_init - Create the key whose destructor flushes a thread's
+ *     cache when the thread exits
+ */
+static void tcache_key_init(void) {
+    pthread_key_create(&tcache_key, tcache_exit);
+}
+
+/*
+ * tcache_flush - Hand the chain of cached blocks starting at bp back
+ *     to their arenas.  Runs of blocks from the home arena are freed
+ *     under one lock acquisition; runs from any other arena are pushed
+ *     onto its remote list with one CAS.
+ */
+static void tcache_flush(void *bp) {
+    void *first, *next;
+    arena_t *a;
+
+    for (; bp != NULL; bp = next) {
+        a = ARENA_OF(bp);
+        first = bp;
+        while ((next = *(void **)bp) != NULL && ARENA_OF(next) == a)
+            bp = next;
+        if (a != home) {
+            remote_push(a, first, bp);
+            continue;
+        }
+        LOCK(a);
+        for (bp = first; bp != next; bp = first) {
+            first = *(void **)bp;
+            heap_free(bp);
+        }
+        UNLOCK();
+    }
+}
+
+/*
+ * tcache_exit - Thread exit hook: return every cached block to the heap
+ */
+static void tcache_exit(void *arg) {
+    tcache_t *tc = arg;
+    int c;
+
+    for (c = 0; c < TCACHE_BINS; c++) {
+        tcache_flush(tc->bins[c]);
+        tc->bins[c] = NULL;
+        tc->count[c] = 0;
+    }
+    tc->live = 0;
+}
+
+/*
+ * tcache_attach - Arrange for this thread's cache to be flushed when
+ *     the thread exits
+ */
+static void tcache_attach(void) {
+    pthread_once(&tcache_once, tcache_key_init);
+    pthread_setspecific(tcache_key, &tcache);
+    tcache.live = 1;
+}
+
+/*
+ * tcache_alloc - Serve a request of at most TCACHE_MAX bytes from the
+ *     calling thread's cache, refilling the bin with TCACHE_BATCH
+ *     blocks from the heap when it is empty
+ */
+static void *tcache_alloc(size_t size) {
+    int c = (size + 7) >> 3;
+    void *bp;
+    int n;
+
+    if (c == 0) {
+#ifdef DRIVER
+        return NULL;
+#else
+        c = 1;      /* a request of 0 gets the smallest block, as in heap_malloc() */
+#endif
+    }
+    if (!tcache.live)
+        tcache_attach();
+
+    if (tcache.bins[c] == NULL) {
+        LOCK_HOME();
+        for (n = 0; n < TCACHE_BATCH; n++) {
+            if ((bp = heap_malloc((size_t)c << 3)) == NULL)
+                break;
+            *(void **)bp = tcache.bins[c];
+            tcache.bins[c] = bp;
+        }
+        UNLOCK();
+        tcache.count[c] = n;
+        if (n == 0)
+            return NULL;
+    }
+
+    bp = tcache.bins[c];
+    tcache.bins[c] = *(void **)bp;
+    tcache.count[c]--;
+    return bp;
+}
+
+/*
+ * tcache_free - Push block bp, which has at least usable payload bytes,
+ *     onto the calling thread's cache and return 1, or return 0 if it
+ *     is too big to cache.  A bin that
+ *     reaches TCACHE_LIMIT blocks gives TCACHE_BATCH of them back.
+ */
+static int tcache_free(void *bp, size_t usable) {
+    int c = usable >> 3;
+    void *chain, *last;
+    int n;
+
+    if (c >= TCACHE_BINS)
+        return 0;
+    if (!tcache.live)
+        tcache_attach();
+
+    *(void **)bp = tcache.bins[c];
+    tcache.bins[c] = bp;
+    if (++tcache.count[c] < TCACHE_LIMIT)
+        return 1;
+
+    chain = last = tcache.bins[c];
+    for (n = 1; n < TCACHE_BATCH; n++)
+        last = *(void **)last;
+    tcache.bins[c] = *(void **)last;
+    tcache.count[c] -= TCACHE_BATCH;
+    *(void **)last = NULL;
+    tcache_flush(chain);
+    return 1;
+}
+#endif /* def THREADS */
+
+/*
+ * usable_size - Number of payload bytes in allocated block bp
+ */
+static size_t usable_size(void *bp) {
+    if (IS_MAPPED(bp))
+        return GET_SIZE(HDRP(bp)) - DSIZE;
+    if (is_slab(bp))
+        return ((slab_t *)((char *)bp - SLAB_OFFSET(bp)))->objsize;
+    return GET_SIZE(HDRP(bp)) - WSIZE;
+}
+
+/*
+ * map_alloc - Serve a request of at least MMAP_MIN bytes from a
+ *     mapping of its own.  The word before the header pads the payload
+ *     to 8-byte alignment.
+ */
+static void *map_alloc(size_t size) {
+    size_t bsize = ALIGN(size + DSIZE);
+    char *q;
+
+    if (size > MAP_MAX)
+        return NULL;
+    MEM_LOCK();
+    q = mem_map(bsize);
+    MEM_UNLOCK();
+    if (q == (void *)-1)
+        return NULL;
+    PUT(q + WSIZE, PACK(bsize, MAPPED | 1));
+    return q + DSIZE;
+}
+
+/*
+ * map_free - Unmap mapped block bp, returning its pages at once
+ */
+static void map_free(void *bp) {
+    MEM_LOCK();
+    mem_unmap((char *)bp - DSIZE);
+    MEM_UNLOCK();
+}
+
+/*
+ * map_realloc - Resize mapped block bp by remapping its pages; a block
+ *     that shrinks below MMAP_MIN moves back into the heap
+ */
+static void *map_realloc(void *bp, size_t size) {
+    size_t bsize = ALIGN(size + DSIZE);
+    char *q;
+
+    if (size < MMAP_MIN) {
+        if ((q = malloc(size)) == NULL)
+            return NULL;
+        memcpy(q, bp, size);
+        map_free(bp);
+        return q;
+    }
+    if (size > MAP_MAX)
+        return NULL;
+    MEM_LOCK();
+    q = mem_remap((char *)bp - DSIZE, bsize);
+    MEM_UNLOCK();
+    if (q == (void *)-1)
+        return NULL;
+    PUT(q + WSIZE, PACK(bsize, MAPPED | 1));
+    return q + DSIZE;
+}
+
+/*
+ * malloc - Small requests come from the thread cache when there is
+ *     one and huge ones get their own mapping; everything else locks
+ *     the thread's home arena
+ */
+void *malloc (size_t size) {
+    void *bp;
+
+#ifdef THREADS
+    if (size <= TCACHE_MAX)
+        return tcache_alloc(size);
+#endif
+    if (size >= MMAP_MIN)
+        return map_alloc(size);
+    LOCK_HOME();
+    bp = heap_malloc(size);
+    UNLOCK();
+    return bp;
+}
+
+/*
+ * free - Mapped blocks are unmapped.  Blocks too big for the thread
+ *     cache go back to the arena that owns them: directly if it is the
+ *     thread's home arena, and through its remote list otherwise.
+ */
+void free (void *ptr) {
+    if (ptr == NULL)
+        return;
+    if (IS_MAPPED(ptr)) {
+        map_free(ptr);
+        return;
+    }
+#ifdef THREADS
+    if (tcache_free(ptr, usable_size(ptr)))
+        return;
+    if (ARENA_OF(ptr) != home) {
+        remote_push(ARENA_OF(ptr), ptr, ptr);
+        return;
+    }
+#endif
+    LOCK(ARENA_OF(ptr));
+    heap_free(ptr);
+    UNLOCK();
+}
+
+#ifdef CHECK_SIZED
+/*
+ * check_sized - Return whether allocated block ptr can have come from a
+ *     request of size bytes, reporting it if not
+ */
+static int check_sized(void *ptr, size_t size) {
+    if (!IS_MAPPED(ptr) && !is_slab(ptr) && !GET_ALLOC(HDRP(ptr))) {
+        printf("Error: free_sized(%p, %zu) of a free block\n", ptr, size);
+        return 0;
+    }
+    if (size > usable_size(ptr)) {
+        printf("Error: free_sized(%p, %zu) of a block of %zu bytes\n",
+               ptr, size, usable_size(ptr));
+        return 0;
+    }
+    return 1;
+}
+#endif
+
+/*
+ * free_sized - free() for callers that know the size they asked for
+ *     (or any size from there up to the usable size).  Such a block is
+ *     no slab object if size is over SLAB_MAX, and with -DTHREADS size
+ *     alone picks the thread cache bin, so neither reads the block or
+ *     its slab page.  Heap blocks still need their header to coalesce.
+ *     Building with -DCHECK_SIZED checks size against the block first,
+ *     and falls back to free() if it is wrong.
+ */
+void free_sized(void *ptr, size_t size) {
+    if (ptr == NULL)
+        return;
+#ifdef CHECK_SIZED
+    if (!check_sized(ptr, size)) {
+        free(ptr);
+        return;
+    }
+#endif
+    if (IS_MAPPED(ptr)) {
+        map_free(ptr);
+        return;
+    }
+#ifdef THREADS
+    if (tcache_free(ptr, MAX(size, 8)))
+        return;
+    if (ARENA_OF(ptr) != home) {
+        remote_push(ARENA_OF(ptr), ptr, ptr);
+        return;
+    }
+#endif
+    LOCK(ARENA_OF(ptr));
+    if (size > SLAB_MAX)
+        heap_free_block(ptr);
+    else
+        heap_free(ptr);
+    UNLOCK();
+}
+
+/*
+ * realloc - Mapped blocks are remapped, and a heap block that grows to
+ *     MMAP_MIN bytes moves to a mapping; heap_realloc() does the rest
+ */
+void *realloc(void *oldptr, size_t size) {
+    size_t oldsize;
+    void *newptr;
+
+    /* Keep the malloc and free halves on their fast paths */
+    if (oldptr == NULL)
+        return malloc(size);
+    if (size == 0) {
+        free(oldptr);
+        return NULL;
+    }
+
+    if (IS_MAPPED(oldptr))
+        return map_realloc(oldptr, size);
+    if (size >= MMAP_MIN) {
+        if ((newptr = map_alloc(size)) == NULL)
+            return NULL;
+        oldsize = usable_size(oldptr);
+        memcpy(newptr, oldptr, oldsize < size ? oldsize : size);
+        free(oldptr);
+        return newptr;
+    }
+
+    LOCK(ARENA_OF(oldptr));
+    newptr = heap_realloc(oldptr, size);
+    UNLOCK();
+    return newptr;
+}
+
+/*
+ * calloc - Allocate zeroed space for nmemb objects of size bytes, or
+ *     return NULL if that many bytes cannot even be counted.  A fresh
+ *     mapping reads as zero, and so does the part of a heap block that
+ *     lies above the arena's fresh mark, apart from the links and the
+ *     footer it had as a free block; only the rest is cleared.
+ */
+void *calloc (size_t nmemb, size_t size) {
+    size_t bytes, dirty;
+    char *bp, *fresh;
+
+    if (nmemb != 0 && size > (size_t)-1 / nmemb) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    bytes = nmemb * size;
+
+    if (bytes >= MMAP_MIN)
+        return map_alloc(bytes);
+#ifdef THREADS
+    if (bytes <= TCACHE_MAX) {
+        if ((bp = tcache_alloc(bytes)) != NULL)
+            memset(bp, 0, bytes);
+        return bp;
+    }
+#endif
+    LOCK_HOME();
+    fresh = arena->fresh;
+    bp = heap_malloc(bytes);
+    UNLOCK();
+    if (bp == NULL)
+        return NULL;
+
+    dirty = MAX(bp < fresh ? (size_t)(fresh - bp) : 0, 2*LSIZE);
+    if (bytes <= SLAB_MAX || dirty >= bytes)
+        memset(bp, 0, bytes);
+    else {
+        memset(bp, 0, dirty);
+        PUT(FTRP(bp), 0);
+    }
+    return bp;
+}
+
+/*
+ * memalign - Allocate size bytes aligned to align, a power of two.
+ *     Anything beyond ALIGNMENT comes from the home arena whatever the
+ *     size, since neither slab objects nor mapped blocks are aligned
+ *     any further: from alloc_padded() up to PAD_ALIGN_MAX, and from
+ *     alloc_aligned() beyond.  Either way the gap in front of the block
+ *     is left free rather than wasted.
+ */
+void *memalign(size_t align, size_t size) {
+    size_t asize;
+    void *bp;
+
+    if (align == 0 || (align & (align - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (align <= ALIGNMENT)
+        return malloc(size);
+    if (size == 0) {
+#ifdef DRIVER
+        return NULL;
+#else
+        size = 1;   /* a unique block, as malloc(0) gives */
+#endif
+    }
+    if (size > MAX_HEAP || align > MAX_HEAP - size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    asize = MAX(MIN_BLOCK, ALIGN(size + WSIZE));
+    LOCK_HOME();
+    if (arena->heap_listp == 0)
+        mm_init();
+    arena->mallocs++;
+    if (align <= PAD_ALIGN_MAX)
+        bp = alloc_padded(align, asize);
+    else
+        bp = alloc_aligned(align, asize);
+    UNLOCK();
+    if (bp == NULL)
+        errno = ENOMEM;
+    return bp;
+}
+
+/*
+ * posix_memalign - memalign() that returns an error number, leaves
+ *     errno alone, and also insists that align is a multiple of
+ *     sizeof(void *)
+ */
+int posix_memalign(void **memptr, size_t align, size_t size) {
+    int saved = errno;
+    void *bp;
+
+    if (align == 0 || align % sizeof(void *) != 0 ||
+        (align & (align - 1)) != 0)
+        return EINVAL;
+    if (size == 0) {
+        *memptr = NULL;
+        return 0;
+    }
+    bp = memalign(align, size);
+    errno = saved;
+    if (bp == NULL)
+        return ENOMEM;
+    *memptr = bp;
+    return 0;
+}
+
+/*
+ * aligned_alloc - The C11 name for memalign()
+ */
+void *aligned_alloc(size_t align, size_t size) {
+    return memalign(align, size);
+}
+
+/*
+ * malloc_usable_size - Number of bytes the caller may use at ptr, which
+ *     is at least what it asked for
+ */
+size_t malloc_usable_size(void *ptr) {
+    return ptr == NULL ? 0 : usable_size(ptr);
+}
+
+/*
+ * malloc_good_size - The usable size malloc() gives a request of size
+ *     bytes: a slab object size, a heap block less its header, or a
+ *     mapping less its two header words.  A block found free can still
+ *     be bigger, if the rest of it was too small to split off.
+ */
+size_t malloc_good_size(size_t size) {
+    if (size <= SLAB_MAX)
+        return slab_sizes[slab_class[(size + 7) >> 3]];
+    if (size >= MMAP_MIN)
+        return size > MAP_MAX ? size : ALIGN(size + DSIZE) - DSIZE;
+    return MAX(MIN_BLOCK, ALIGN(size + WSIZE)) - WSIZE;
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks of size bytes each into out[0..n-1]
+ *     and return how many were allocated, which is less than n only if
+ *     memory ran out.  Heap blocks are taken under one lock acquisition,
+ *     several at a time from each free block found.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out) {
+    size_t i = 0;
+
+#ifdef THREADS
+    if (size <= TCACHE_MAX) {
+        while (i < n && (out[i] = tcache_alloc(size)) != NULL)
+            i++;
+        return i;
+    }
+#endif
+    if (size >= MMAP_MIN) {
+        while (i < n && (out[i] = map_alloc(size)) != NULL)
+            i++;
+        return i;
+    }
+    LOCK_HOME();
+    i = heap_malloc_batch(size, n, out);
+    UNLOCK();
+    return i;
+}
+
+/*
+ * mm_free_batch - Free the n blocks in ptrs, any of which may be NULL.
+ *     Each arena is locked once per run of its blocks, and blocks that
+ *     are neighbours both in ptrs and in the heap are coalesced in one
+ *     go, so a batch sorted by address (such as one from
+ *     mm_malloc_batch()) is freed in a single sweep.  Blocks go straight
+ *     back to their arenas, bypassing the thread cache.
+ */
+void mm_free_batch(void **ptrs, size_t n) {
+    size_t i = 0;
+
+    while (i < n) {
+        if (ptrs[i] == NULL) {
+            i++;
+            continue;
+        }
+        if (IS_MAPPED(ptrs[i])) {
+            map_free(ptrs[i++]);
+            continue;
+        }
+        LOCK(ARENA_OF(ptrs[i]));
+        do
+            i = heap_free_run(ptrs, i, n);
+        while (i < n && ptrs[i] != NULL && !IS_MAPPED(ptrs[i]) &&
+               ARENA_OF(ptrs[i]) == arena);
+        UNLOCK();
+    }
+}
+
+/*
+ * largest_free - Size of the current arena's biggest free block.  The
+ *     largest node of the tree is splayed to the root; otherwise only
+ *     the highest non-empty list is searched.
+ */
+static size_t largest_free(void) {
+    size_t max = arena->wild != NULL ? GET_SIZE(HDRP(arena->wild)) : 0;
+    char *bp = NULL;
+    int i;
+
+#ifdef TLSF
+    if (arena->fl_map != 0) {
+        i = 31 - __builtin_clz(arena->fl_map);
+        bp = arena->seg_lists[i * SL_COUNT +
+                              31 - __builtin_clz(arena->sl_map[i])];
+    }
+#else
+    if (arena->tree_root != NULL) {
+        arena->tree_root = splay(arena->tree_root, (size_t)-1, (char *)-1);
+        return MAX(max, GET_SIZE(HDRP(arena->tree_root)));
+    }
+    if (arena->bin_map != 0) {
+        i = 31 - __builtin_clz(arena->bin_map);
+        bp = arena->seg_lists[i];
+    }
+#endif
+    for (; bp != NULL; bp = NEXT_FREE(bp))
+        max = MAX(max, GET_SIZE(HDRP(bp)));
+    return max;
+}
+
+/*
+ * mm_stats - Fill in st from the counters the arenas keep as they go,
+ *     summed over all arenas with -DTHREADS.  Allocated bytes include
+ *     boundary tags and whole slab pages; blocks parked on the quick
+ *     lists count as neither allocated nor free, and blocks in thread
+ *     caches as allocated.
+ */
+void mm_stats(mm_stats_t *st) {
+    size_t free_bytes;
+    int i, j, n = 1;
+#ifdef THREADS
+    arena_t *self = arena;
+
+    n = narenas;
+#endif
+
+    memset(st, 0, sizeof(*st));
+    for (i = 0; i < n; i++) {
+#ifdef THREADS
+        LOCK(&arenas[i]);
+#endif
+        if (arena->heap_listp != NULL) {
+            free_bytes = arena->free_bytes;
+            for (j = 0; j < MM_STATS_CLASSES; j++)
+                st->free_blocks[j] += arena->free_blocks[j];
+            if (arena->wild != NULL) {
+                free_bytes += GET_SIZE(HDRP(arena->wild));
+                st->free_blocks[STAT_CLASS(GET_SIZE(HDRP(arena->wild)))]++;
+            }
+            st->heap_bytes += arena->heapsize;
+            st->free_bytes += free_bytes;
+            st->parked_bytes += arena->quick_bytes;
+            st->alloc_bytes += arena->heapsize - free_bytes - arena->quick_bytes;
+            st->largest_free = MAX(st->largest_free, largest_free());
+            for (j = 0; j < 4; j++)
+                st->coalesces[j] += arena->coalesces[j];
+        }
+        UNLOCK();
+    }
+#ifdef THREADS
+    arena = self;
+#endif
+
+    MEM_LOCK();
+    st->mapped_bytes = mem_mapsize();
+    st->sbrks = mem_sbrk_calls();
+    MEM_UNLOCK();
+}
+
+
+/*
+ * Return whether the pointer is in the heap.
+ * May be useful for debugging.
+ */
+static int in_heap(const void *p) {
+    return p <= mem_heap_hi() && p >= mem_heap_lo();
+}
+
+/*
+ * Return whether the pointer is aligned.
+ * May be useful for debugging.
+ */
+static int aligned(const void *p) {
+    return (size_t)ALIGN(p) == (size_t)p;
+}
+
+/*
+ * mm_checkheap - Walk the heap and every free list, checking that the
+ *     two views agree: each free block in the heap is on exactly the
+ *     list for its size class, the lists are properly doubly linked,
+ *     no two adjacent blocks are both free, and every header's
+ *     PREV_ALLOC bit matches the block before it.  Large free blocks
+ *     are counted by an in-order walk of the tree instead, and a free
+ *     top block must be the wilderness, on no list at all.  Slab pages
+ *     found on the walk get their own consistency check, and so do
+ *     the quick lists, whose blocks must all look allocated.  With
+ *     -DTHREADS every arena is checked, chunk by chunk.  It takes no
+ *     lock (printf may call malloc), so then only call it while no
+ *     other thread is allocating.
+ */
+void mm_checkheap(int verbose) {
+#ifdef THREADS
+    arena_t *self = arena;
+    int i;
+
+    for (i = 0; i < narenas; i++) {
+        arena = &arenas[i];
+        if (arena->heap_listp != NULL)
+            checkarena(verbose);
+    }
+    arena = self;
+#else
+    checkarena(verbose);
+#endif
+}
+
+/*
+ * checkchunk - Walk the blocks from prologue bp to the epilogue after
+ *     it and return how many of them are free
+ */
+static size_t checkchunk(char *bp, int verbose) {
+    size_t nfree = 0;
+    int prev_free = 0;   /* the prologue is allocated */
+    char *last = bp;
+
+    if (verbose)
+        printf("Heap (%p):\n", bp);
+
+    if ((GET_SIZE(HDRP(bp)) != DSIZE) || !GET_ALLOC(HDRP(bp)))
+        printf("Bad prologue header\n");
+    checkblock(bp);
+
+    for (; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        if (verbose)
+            printblock(bp);
+        checkblock(bp);
+#ifdef THREADS
+        if (ARENA_OF(bp) != arena)
+            printf("Error: %p lies in another arena's chunk\n", bp);
+#endif
+        if (GET_ALLOC(HDRP(bp)) && SLAB_OFFSET(bp) == 0 && is_slab(bp))
+            checkslab((slab_t *)bp);
+        if ((!GET_PREV_ALLOC(HDRP(bp))) != prev_free)
+            printf("Error: %p has a stale prev-allocated bit\n", bp);
+        if (!GET_ALLOC(HDRP(bp))) {
+            if (prev_free)
+                printf("Error: %p and its predecessor are both free\n", bp);
+            nfree++;
+        }
+        prev_free = !GET_ALLOC(HDRP(bp));
+        last = bp;
+    }
+
+    if (verbose)
+        printblock(bp);
+    if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
+        printf("Bad epilogue header\n");
+    if ((!GET_PREV_ALLOC(HDRP(bp))) != prev_free)
+        printf("Error: epilogue has a stale prev-allocated bit\n");
+    if (prev_free && AT_TOP(last) && last != arena->wild)
+        printf("Error: free top block %p is not the wilderness\n", last);
+    return nfree;
+}
+
+/*
+ * checkarena - mm_checkheap for the current arena
+ */
+static void checkarena(int verbose) {
+    char *fp;
+    size_t heap_free = 0, list_free = 0, quick_bytes;
+    int i;
+
+#ifdef THREADS
+    for (fp = arena->chunks; fp != NULL; fp = *(char **)fp)
+        heap_free += checkchunk(fp + CHUNK_HDR - DSIZE, verbose);
+#else
+    heap_free = checkchunk(arena->heap_listp, verbose);
+#endif
+
+    for (i = 0; i < NUM_LISTS; i++) {
+        if ((!list_marked(i)) != (arena->seg_lists[i] == NULL))
+            printf("Error: bitmap bit %d disagrees with free list\n", i);
+        for (fp = arena->seg_lists[i]; fp != NULL; fp = NEXT_FREE(fp)) {
+            if (!in_heap(fp) || !aligned(fp)) {
+                printf("Error: free list %d holds bad pointer %p\n", i, fp);
+                break;
+            }
+            if (GET_ALLOC(HDRP(fp)))
+                printf("Error: allocated block %p on free list %d\n", fp, i);
+            if (size_class(GET_SIZE(HDRP(fp))) != i)
+                printf("Error: block %p of size %u on wrong list %d\n",
+                       fp, GET_SIZE(HDRP(fp)), i);
+            if (NEXT_FREE(fp) != NULL && PREV_FREE(NEXT_FREE(fp)) != fp)
+                printf("Error: broken prev link after %p\n", fp);
+            list_free++;
+        }
+    }
+
+#ifndef TLSF
+    fp = NULL;
+    list_free += checktree(arena->tree_root, &fp);
+#endif
+    if (arena->wild != NULL) {
+        if (GET_ALLOC(HDRP(arena->wild)) || !AT_TOP(arena->wild))
+            printf("Error: wilderness %p is not the free top block\n",
+                   arena->wild);
+        list_free++;
+    }
+
+    if (heap_free != list_free)
+        printf("Error: %zu free blocks in heap but %zu on free lists\n",
+               heap_free, list_free);
+    for (i = 0, list_free = arena->wild != NULL; i < MM_STATS_CLASSES; i++)
+        list_free += arena->free_blocks[i];
+    if (heap_free != list_free)
+        printf("Error: %zu free blocks in heap but %zu counted\n",
+               heap_free, list_free);
+
+    for (i = 0, quick_bytes = 0; i < QUICK_BINS; i++) {
+        if ((!((arena->quick_map >> i) & 1)) != (arena->quick[i] == NULL))
+            printf("Error: quick map bit %d disagrees with quick list\n", i);
+        for (fp = arena->quick[i]; fp != NULL; fp = NEXT_FREE(fp)) {
+            if (!in_heap(fp) || !aligned(fp)) {
+                printf("Error: quick list %d holds bad pointer %p\n", i, fp);
+                break;
+            }
+            if (!GET_ALLOC(HDRP(fp)) || is_slab(fp))
+                printf("Error: quick list %d holds non-parked block %p\n",
+                       i, fp);
+            if (GET_SIZE(HDRP(fp)) != TAIL_MIN + 8 * (size_t)i)
+                printf("Error: block %p of size %u on wrong quick list %d\n",
+                       fp, GET_SIZE(HDRP(fp)), i);
+            quick_bytes += GET_SIZE(HDRP(fp));
+        }
+    }
+    if (quick_bytes != arena->quick_bytes)
+        printf("Error: %zu bytes on quick lists but %zu counted\n",
+               quick_bytes, arena->quick_bytes);
+
+    for (i = 0; i < SLAB_CLASSES; i++) {
+        slab_t *sp;
+
+        for (sp = arena->slab_partial[i]; sp != NULL; sp = sp->next) {
+            if (!is_slab(sp) || SLAB_OFFSET(sp) != 0) {
+                printf("Error: slab list %d holds bad page %p\n", i, sp);
+                break;
+            }
+            if (sp->objsize != slab_sizes[i] || sp->nfree == 0)
+                printf("Error: slab %p is on the wrong list %d\n", sp, i);
+            if (sp->next != NULL && sp->next->prev != sp)
+                printf("Error: broken prev link after slab %p\n", sp);
+        }
+    }
+}
+
+/*
+ * Extend heap with free blocks and return its block pointer
+ */
+static void *extend_heap(size_t words){
+    char *bp, *tags;
+    size_t size;
+    int bury;
+
+    /*Allocate an even number of words to maintain alignments*/
+    size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
+    if((long)(bp = SBRK(size)) == -1)
+        return NULL;
+    arena->heapsize += size;
+
+    /*Intialize free block header/footer and the epilogue header.
+      The old epilogue header becomes the new block's header, so it
+      already knows whether the previous block is allocated.*/
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)))); /*Free block header*/
+    PUT(FTRP(bp), GET(HDRP(bp))); /*Free block Footer*/
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /*The new epilogue block*/
+
+    /*Coalasce if the previous block is free.  Its footer and our
+      header then end up inside the merged block, so in the fresh part
+      of the heap they are cleared.*/
+    tags = (char *)bp - DSIZE;
+    bury = !GET_PREV_ALLOC(HDRP(bp)) && tags >= arena->fresh;
+    bp = coalesce(bp);
+    if (bury) {
+        PUT(tags, 0);
+        PUT(tags + WSIZE, 0);
+    }
+    return bp;
+}
+
+/*
+ * grow_step - How far to grow the heap when it has run out and at least
+ *     need more bytes are wanted: the arena's step, which doubles each
+ *     time the heap runs out again within GROW_FAST mallocs, halves
+ *     when it lasted GROW_SLOW, and stays between CHUNKSIZE and the
+ *     smaller of GROW_MAX and 1/GROW_FRAC of the heap
+ */
+static size_t grow_step(size_t need) {
+    unsigned long since = arena->mallocs - arena->grown_at;
+    size_t cap = MAX(CHUNKSIZE, MIN(GROW_MAX, arena->heapsize / GROW_FRAC));
+
+    arena->grown_at = arena->mallocs;
+    if (since < GROW_FAST)
+        arena->grow = MIN(2 * arena->grow, cap);
+    else if (since >= GROW_SLOW)
+        arena->grow = MAX(arena->grow / 2, CHUNKSIZE);
+    return MAX(need, MIN(arena->grow, cap));
+}
+
+/*
+ * grow_heap - Extend the heap so that the wilderness holds at least
+ *     asize bytes, which it must not yet, and return it.  An existing
+ *     wilderness is only topped up by the deficit; otherwise the heap
+ *     grows by grow_step().
+ */
+static void *grow_heap(size_t asize) {
+    size_t size;
+
+    if (RESERVE(asize) < 0)
+        return NULL;
+
+    if (arena->wild != NULL) {
+        arena->grown_at = arena->mallocs;
+        size = MAX(asize - GET_SIZE(HDRP(arena->wild)), MIN_BLOCK);
+        return extend_heap(size/WSIZE);
+    }
+    return extend_heap(grow_step(asize)/WSIZE);
+}
+
+/*
+ * wild_alloc - Bump allocator: carve a block of asize bytes off the
+ *     bottom of the wilderness, which must be big enough.  It is on no
+ *     list, so only the boundary tags change.
+ */
+static void *wild_alloc(size_t asize) {
+    char *bp = arena->wild;
+    size_t wsize = GET_SIZE(HDRP(bp));
+    size_t purged = GET(HDRP(bp)) & PURGED;
+
+    if ((wsize - asize) >= MIN_BLOCK) {
+        PUT(HDRP(bp), PACK(asize, PREV_ALLOC | 1));
+        arena->wild = NEXT_BLKP(bp);
+        PUT(HDRP(arena->wild), PACK(wsize - asize, PREV_ALLOC | purged));
+        PUT(FTRP(arena->wild), PACK(wsize - asize, PREV_ALLOC | purged));
+    }
+    else {
+        PUT(HDRP(bp), PACK(wsize, PREV_ALLOC | 1));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+        arena->wild = NULL;
+    }
+    NOTE_USED(bp);
+    return bp;
+}
+
+/*
+ * coalesce - Merge free block bp with any free neighbours, put the
+ *     result on its free list and return it.  The caller has already
+ *     cleared the PREV_ALLOC bit of the block after bp.  Whatever
+ *     precedes the merged block is allocated, so its header always
+ *     carries PREV_ALLOC.
+ */
+static void* coalesce(void *bp) {
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+    size_t size = GET_SIZE(HDRP(bp));
+
+    arena->coalesces[2*!prev_alloc + !next_alloc]++;
+
+    if (prev_alloc && next_alloc) {            /* Case 1 */
+    }
+
+    else if (prev_alloc && !next_alloc) {      /* Case 2 */
+        remove_free(NEXT_BLKP(bp));
+        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(size, PREV_ALLOC));
+    }
+
+    else if (!prev_alloc && next_alloc) {      /* Case 3 */
+        remove_free(PREV_BLKP(bp));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+        PUT(FTRP(bp), PACK(size, PREV_ALLOC));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, PREV_ALLOC));
         bp = PREV_BLKP(bp);
     }
-#ifdef NEXT_FIT
-    /* Make sure the rover isn't pointing into the free block */
-    /* that we just coalesced */
-    if ((rover > (char *)bp) && (rover < NEXT_BLKP(bp))) 
-        rover = bp;
-#endif
+
+    else {                                     /* Case 4 */
+        remove_free(PREV_BLKP(bp));
+        remove_free(NEXT_BLKP(bp));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp))) +
+            GET_SIZE(FTRP(NEXT_BLKP(bp)));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, PREV_ALLOC));
+        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, PREV_ALLOC));
+        bp = PREV_BLKP(bp);
+    }
+
+    insert_free(bp);
     return bp;
-} 
+}
 
-/* 
- * place - Place block of asize bytes at start of free block bp 
- *         and split if remainder would be at least minimum block size
+/*
+ * place - Place block of asize bytes at start of free block bp
+ *         and split if remainder would be at least minimum block size.
+ *         A free block never follows another free block, so bp's
+ *         predecessor is allocated.
  */
 static void place(void *bp, size_t asize) {
     size_t csize = GET_SIZE(HDRP(bp));
+    size_t purged = GET(HDRP(bp)) & PURGED;   /* Still true of the rest */
+
+    remove_free(bp);
 
-    if((csize - asize) >= (2 * DSIZE)) {
-        PUT(HDRP(bp), PACK(asize, 1));
-        PUT(FTRP(bp), PACK(asize, 1));
+    if((csize - asize) >= SPLIT_MIN) {
+        PUT(HDRP(bp), PACK(asize, PREV_ALLOC | 1));
+        NOTE_USED(bp);
         bp = NEXT_BLKP(bp);
-        PUT(HDRP(bp), PACK(csize-asize, 0));
-        PUT(FTRP(bp), PACK(csize-asize, 0)); 
+        PUT(HDRP(bp), PACK(csize-asize, PREV_ALLOC | purged));
+        PUT(FTRP(bp), PACK(csize-asize, PREV_ALLOC | purged));
+        insert_free(bp);
+    }
+    else { /*The remainder is too small for a block, thus no split*/
+        PUT(HDRP(bp), PACK(csize, PREV_ALLOC | 1));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+        NOTE_USED(bp);
+    }
+}
+
+/*
+ * shrink_block - Cut allocated block bp down to asize bytes, returning
+ *     the tail to the free lists unless it is smaller than TAIL_MIN
+ */
+static void shrink_block(void *bp, size_t asize) {
+    size_t csize = GET_SIZE(HDRP(bp));
+    char *rest;
+
+    if ((csize - asize) < TAIL_MIN)
+        return;
+
+    PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | 1));
+    rest = NEXT_BLKP(bp);
+    PUT(HDRP(rest), PACK(csize-asize, PREV_ALLOC | 1));
+    free_block(rest);
+}
+
+/*
+ * alloc_aligned - Allocate a block of asize bytes whose payload is
+ *     aligned to align bytes relative to the start of the heap.  The
+ *     block is carved from the top of a free block; the part in front
+ *     of it goes back on the free lists.  Carving from the top means
+ *     that blocks of exactly align bytes taken one after another from
+ *     the same free block end up packed back to back with no gaps.
+ *     The wilderness is the exception: it has to stay on top, so it
+ *     gives up its lowest aligned payload instead, which packs such
+ *     blocks just the same.
+ */
+static void *alloc_aligned(size_t align, size_t asize) {
+    size_t search = asize + align + MIN_BLOCK;  /* Room for any gap */
+    size_t csize, gap, purged;
+    char *bp, *abp;
+
+    /* A plain fit will do if it happens to have an aligned top;
+     * otherwise look for a block that is big enough for any gap */
+    if ((bp = find_fit(asize)) != NULL) {
+        csize = GET_SIZE(HDRP(bp));
+        abp = bp + csize - asize;
+        abp -= (abp - (char *)mem_heap_lo()) & (align - 1);
+        if (abp < bp || (abp != bp && (size_t)(abp - bp) < MIN_BLOCK))
+            bp = NULL;
+    }
+    if (bp == NULL && (bp = find_fit(search)) == NULL &&
+        (!quick_consolidate() || (bp = find_fit(search)) == NULL)) {
+        if ((arena->wild == NULL || GET_SIZE(HDRP(arena->wild)) < search) &&
+            grow_heap(search) == NULL)
+            return NULL;
+        bp = arena->wild;
+    }
+    csize = GET_SIZE(HDRP(bp));
+    purged = GET(HDRP(bp)) & PURGED;
+
+    if (bp == arena->wild) {
+        /* Lowest aligned payload with room for a free block before it */
+        abp = bp + ((align - ((bp - (char *)mem_heap_lo()) & (align - 1)))
+                    & (align - 1));
+        if (abp != bp && (size_t)(abp - bp) < MIN_BLOCK)
+            abp += align;
+    }
+    else {
+        /* Highest aligned payload that still fits */
+        abp = bp + csize - asize;
+        abp -= (abp - (char *)mem_heap_lo()) & (align - 1);
+    }
+    gap = abp - bp;
+    remove_free(bp);
+
+    if (gap == 0) {
+        PUT(HDRP(bp), PACK(csize, PREV_ALLOC | 1));
+    }
+    else {
+        PUT(HDRP(bp), PACK(gap, PREV_ALLOC | purged));
+        PUT(FTRP(bp), PACK(gap, PREV_ALLOC | purged));
+        PUT(HDRP(abp), PACK(csize - gap, 1));
+        insert_free(bp);
+    }
+    SET_PREV_ALLOC(HDRP(NEXT_BLKP(abp)));
+    shrink_block(abp, asize);
+    NOTE_USED(abp);
+    return abp;
+}
+
+/*
+ * alloc_padded - alloc_aligned() for small alignments: take an ordinary
+ *     block with room for any gap, then free the gap in front of the
+ *     aligned payload and trim the tail.  This is the malloc(size +
+ *     align - 1) workaround without its waste, and for small alignments
+ *     it is cheaper than looking for a block whose top is aligned.
+ */
+static void *alloc_padded(size_t align, size_t asize) {
+    size_t need, search, csize, gap;
+    char *bp, *abp;
+
+    /* The largest gap is align + ALIGNMENT, when the first one would
+     * be too small for a free block */
+    need = asize + align + ALIGNMENT;
+    search = need;
+#ifndef TLSF
+    /* Any block in the next class up is big enough, so search for its
+     * smallest size: first fit then takes the head of that list rather
+     * than walking past the gaps earlier calls left in this one */
+    if (need < LARGE_MIN)
+        search = ((size_t)1 << (size_class(need) + 5)) + DSIZE;
+#endif
+
+    if ((bp = find_fit(search)) != NULL ||
+        (quick_consolidate() && (bp = find_fit(search)) != NULL))
+        place(bp, need);
+    else {
+        if ((arena->wild == NULL || GET_SIZE(HDRP(arena->wild)) < need) &&
+            grow_heap(need) == NULL)
+            return NULL;
+        bp = wild_alloc(need);
+    }
+    csize = GET_SIZE(HDRP(bp));
+
+    gap = (align - ((bp - (char *)mem_heap_lo()) & (align - 1))) & (align - 1);
+    if (gap != 0 && gap < MIN_BLOCK)
+        gap += align;
+    abp = bp + gap;
+    if (gap != 0) {
+        PUT(HDRP(abp), PACK(csize - gap, 1));
+        PUT(HDRP(bp), PACK(gap, GET_PREV_ALLOC(HDRP(bp)) | 1));
+        free_block(bp);
+    }
+    shrink_block(abp, asize);
+    return abp;
+}
+
+/*
+ * is_slab - Return whether p points into a slab page
+ */
+static int is_slab(const void *p) {
+    size_t i = SLAB_INDEX(p);
+
+    return (slab_pages[i / 64] >> (i % 64)) & 1;
+}
+
+/*
+ * slab_alloc - Hand out an object of the slab class for size bytes,
+ *     opening a new slab page if the class has none with room
+ */
+static void *slab_alloc(size_t size) {
+    int c = slab_class[(size + 7) >> 3];
+    slab_t *s = arena->slab_partial[c];
+    size_t i, n;
+    int w, b;
+
+    if (s == NULL) {
+        if ((s = alloc_aligned(SLAB_SIZE, SLAB_SIZE)) == NULL)
+            return NULL;
+        i = SLAB_INDEX(s);
+        SLAB_MARK(i);
+        s->objsize = slab_sizes[c];
+        s->nfree = n = SLAB_NOBJS(s);
+        for (w = 0; w < SLAB_WORDS; w++, n -= (n < 64 ? n : 64))
+            s->freemap[w] = (n >= 64) ? ~0UL : (1UL << n) - 1;
+        s->next = s->prev = NULL;
+        arena->slab_partial[c] = s;
+    }
+
+    for (w = 0; s->freemap[w] == 0; w++)
+        ;
+    b = __builtin_ctzl(s->freemap[w]);
+    s->freemap[w] &= ~(1UL << b);
+
+    /* A full page leaves the partial list */
+    if (--s->nfree == 0) {
+        arena->slab_partial[c] = s->next;
+        if (s->next != NULL)
+            s->next->prev = NULL;
+    }
+    return (char *)s + SLAB_HDR + (size_t)(w * 64 + b) * s->objsize;
+}
+
+/*
+ * slab_free - Return object p to its slab page
+ */
+static void slab_free(void *p) {
+    slab_t *s = (slab_t *)((char *)p - SLAB_OFFSET(p));
+    int c = slab_class[s->objsize >> 3];
+    size_t obj = ((char *)p - (char *)s - SLAB_HDR) / s->objsize;
+    size_t i;
+
+    s->freemap[obj / 64] |= 1UL << (obj % 64);
+
+    /* A page that was full rejoins the partial list */
+    if (s->nfree++ == 0) {
+        s->prev = NULL;
+        s->next = arena->slab_partial[c];
+        if (s->next != NULL)
+            s->next->prev = s;
+        arena->slab_partial[c] = s;
     }
-    else { /*The remainder is less than 2 double words, thus no split*/ 
-        PUT(HDRP(bp), PACK(csize, 1));
-        PUT(FTRP(bp), PACK(csize, 1));
+
+    /* Give an empty page back to the heap unless it is the last one */
+    if (s->nfree == SLAB_NOBJS(s) && (s->prev != NULL || s->next != NULL)) {
+        if (s->prev != NULL)
+            s->prev->next = s->next;
+        else
+            arena->slab_partial[c] = s->next;
+        if (s->next != NULL)
+            s->next->prev = s->prev;
+        i = SLAB_INDEX(s);
+        SLAB_UNMARK(i);
+        heap_free(s);
+    }
+}
+
+/*
+ * checkslab - Check that slab page s agrees with its own free map
+ */
+static void checkslab(slab_t *s) {
+    size_t nfree = 0;
+    int w;
+
+    if (s->objsize > SLAB_MAX || slab_sizes[slab_class[s->objsize >> 3]]
+        != s->objsize) {
+        printf("Error: slab %p has bad object size %u\n", s, s->objsize);
+        return;
     }
+    for (w = 0; w < SLAB_WORDS; w++)
+        nfree += __builtin_popcountl(s->freemap[w]);
+    if (nfree != s->nfree)
+        printf("Error: slab %p counts %u free objects, map has %zu\n",
+               s, s->nfree, nfree);
 }
 
 /*
- *find_fit - Find a fit for a block with asize
+ *find_fit - Find a fit for a block with asize.  Only the list for its
+ *           own size class needs searching: any block on a larger
+ *           class's list is big enough, so past the first class we take
+ *           the head of the next non-empty list straight from bin_map
+ *           (or, for the best-fit policies, the best block on it).
  */
+#ifndef TLSF
 static void *find_fit(size_t asize){
-#ifdef NEXT_FIT 
-    /* Next fit search */
-    char *oldrover = rover;
-
-    /* Search from the rover to the end of list */
-    for ( ; GET_SIZE(HDRP(rover)) > 0; rover = NEXT_BLKP(rover))
-        if (!GET_ALLOC(HDRP(rover)) && (asize <= GET_SIZE(HDRP(rover))))
-            return rover;
-
-    /* search from start of list to old rover */
-    for (rover = heap_listp; rover < oldrover; rover = NEXT_BLKP(rover))
-        if (!GET_ALLOC(HDRP(rover)) && (asize <= GET_SIZE(HDRP(rover))))
-            return rover;
-
-    return NULL;  /* no fit found */
-#else 
-    /* First fit search */
-    void *bp;
+    int i;
+    unsigned int map;
+    char *bp;
+
+    if (asize >= LARGE_MIN)
+        return tree_best_fit(asize);
+    i = size_class(asize);
+    if ((bp = list_fit(i, asize)) != NULL)
+        return bp;
+
+    /* Skip straight to the first non-empty larger class */
+    map = arena->bin_map & (~1u << i);
+    if (map == 0)
+        return tree_best_fit(asize);
+#if FIT == FIT_BEST || FIT == FIT_BOUNDED
+    return list_fit(__builtin_ctz(map), asize);
+#else
+    return arena->seg_lists[__builtin_ctz(map)];
+#endif
+}
+
+/*
+ * list_fit - Search free list i for a block of at least asize bytes
+ *     the way the fit policy says, or return NULL
+ */
+#if FIT == FIT_NEXT
+static char *list_fit(int i, size_t asize) {
+    /* Next fit search: resume from where this list was last used */
+    char *start = arena->rover[i] ? arena->rover[i] : arena->seg_lists[i];
+    char *bp;
+
+    for (bp = start; bp != NULL; bp = NEXT_FREE(bp))
+        if (asize <= GET_SIZE(HDRP(bp)))
+            return arena->rover[i] = bp;
+    for (bp = arena->seg_lists[i]; bp != start; bp = NEXT_FREE(bp))
+        if (asize <= GET_SIZE(HDRP(bp)))
+            return arena->rover[i] = bp;
+    return NULL;
+}
+#elif FIT == FIT_BEST || FIT == FIT_BOUNDED
+static char *list_fit(int i, size_t asize) {
+    char *bp, *best = NULL;
+    size_t size, best_size = 0;
+#if FIT == FIT_BOUNDED
+    int seen = 0;
+#endif
+
+    /* Best fit search, stopping early at an exact fit */
+    for (bp = arena->seg_lists[i]; bp != NULL; bp = NEXT_FREE(bp)) {
+        if ((size = GET_SIZE(HDRP(bp))) < asize)
+            continue;
+        if (best == NULL || size < best_size) {
+            best = bp;
+            best_size = size;
+            if (size == asize)
+                break;
+        }
+#if FIT == FIT_BOUNDED
+        if (++seen == FIT_K)
+            break;
+#endif
+    }
+    return best;
+}
+#else
+static char *list_fit(int i, size_t asize) {
+    char *bp;
 
-    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
-        if (!GET_ALLOC(HDRP(bp)) && (asize <= GET_SIZE(HDRP(bp)))) {
+    /* First fit search */
+    for (bp = arena->seg_lists[i]; bp != NULL; bp = NEXT_FREE(bp)) {
+        if (asize <= GET_SIZE(HDRP(bp))) {
             return bp;
         }
     }
-    return NULL; /* No fit */
+    return NULL;
+}
+#endif
+
+/*
+ * size_class - Return the index of the free list for blocks of size
+ *     bytes: list i holds sizes in (2^(i+4), 2^(i+5)]
+ */
+static int size_class(size_t size) {
+    int i;
+
+    if (size <= 32)
+        return 0;
+    i = (int)(8 * sizeof(long)) - __builtin_clzl(size - 1) - 5;
+    return (i < NUM_CLASSES) ? i : NUM_CLASSES - 1;
+}
+
+/*
+ * list_marked - Return whether bin_map records list i as non-empty
+ */
+static int list_marked(int i) {
+    return (arena->bin_map >> i) & 1;
+}
+
+static void mark_list(int i) {
+    arena->bin_map |= 1u << i;
+}
+
+static void unmark_list(int i) {
+    arena->bin_map &= ~(1u << i);
+}
+
+/*
+ * splay - Top-down splay of tree t on key (size, addr).  Returns the
+ *     new root: the node with that key if present, otherwise its
+ *     in-order neighbour on one side or the other.
+ */
+static char *splay(char *t, size_t size, const char *addr) {
+    char *l = NULL, *r = NULL;      /* Roots of the left and right trees */
+    char *lt = NULL, *rt = NULL;    /* Their max and min nodes */
+    char *y;
+
+    if (t == NULL)
+        return NULL;
+    for (;;) {
+        if (KEY_LESS(size, addr, t)) {
+            if (LEFT(t) == NULL)
+                break;
+            if (KEY_LESS(size, addr, LEFT(t))) {   /* Rotate right */
+                y = LEFT(t);
+                SET_LEFT(t, RIGHT(y));
+                SET_RIGHT(y, t);
+                t = y;
+                if (LEFT(t) == NULL)
+                    break;
+            }
+            if (rt == NULL) r = t; else SET_LEFT(rt, t);  /* Link right */
+            rt = t;
+            t = LEFT(t);
+        }
+        else if (KEY_GREATER(size, addr, t)) {
+            if (RIGHT(t) == NULL)
+                break;
+            if (KEY_GREATER(size, addr, RIGHT(t))) {  /* Rotate left */
+                y = RIGHT(t);
+                SET_RIGHT(t, LEFT(y));
+                SET_LEFT(y, t);
+                t = y;
+                if (RIGHT(t) == NULL)
+                    break;
+            }
+            if (lt == NULL) l = t; else SET_RIGHT(lt, t); /* Link left */
+            lt = t;
+            t = RIGHT(t);
+        }
+        else
+            break;
+    }
+
+    /* Reassemble */
+    if (lt != NULL) {
+        SET_RIGHT(lt, LEFT(t));
+        SET_LEFT(t, l);
+    }
+    if (rt != NULL) {
+        SET_LEFT(rt, RIGHT(t));
+        SET_RIGHT(t, r);
+    }
+    return t;
+}
+
+/*
+ * tree_insert - Add large free block bp to the tree as its new root
+ */
+static void tree_insert(char *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    char *t;
+
+    if (arena->tree_root == NULL) {
+        SET_LEFT(bp, NULL);
+        SET_RIGHT(bp, NULL);
+    }
+    else {
+        t = splay(arena->tree_root, size, bp);
+        if (KEY_LESS(size, bp, t)) {
+            SET_LEFT(bp, LEFT(t));
+            SET_RIGHT(bp, t);
+            SET_LEFT(t, NULL);
+        }
+        else {
+            SET_RIGHT(bp, RIGHT(t));
+            SET_LEFT(bp, t);
+            SET_RIGHT(t, NULL);
+        }
+    }
+    arena->tree_root = bp;
+}
+
+/*
+ * tree_remove - Unlink large free block bp from the tree
+ */
+static void tree_remove(char *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    char *t = splay(arena->tree_root, size, bp);
+
+    if (LEFT(t) == NULL) {
+        arena->tree_root = RIGHT(t);
+    }
+    else {
+        /* bp is larger than its whole left subtree, so this splay brings
+         * the subtree's maximum, which has no right child, to the top */
+        arena->tree_root = splay(LEFT(t), size, bp);
+        SET_RIGHT(arena->tree_root, RIGHT(t));
+    }
+}
+
+/*
+ * tree_best_fit - Return the smallest large free block of at least
+ *     asize bytes (lowest address among equals), or NULL
+ */
+static void *tree_best_fit(size_t asize) {
+    char *t;
+
+    if (arena->tree_root == NULL)
+        return NULL;
+    t = arena->tree_root = splay(arena->tree_root, asize, NULL);
+    if (GET_SIZE(HDRP(t)) >= asize)
+        return t;
+    for (t = RIGHT(t); t != NULL && LEFT(t) != NULL; t = LEFT(t))
+        ;
+    return t;
+}
+
+/*
+ * checktree - In-order walk of tree t, checking that every node is a
+ *     large free block and that keys strictly increase.  *last is the
+ *     previously visited node.  Returns the number of nodes.
+ */
+static size_t checktree(char *t, char **last) {
+    size_t n;
+
+    if (t == NULL)
+        return 0;
+    n = checktree(LEFT(t), last);
+    if (!in_heap(t) || !aligned(t)) {
+        printf("Error: tree holds bad pointer %p\n", t);
+        return n;
+    }
+    if (GET_ALLOC(HDRP(t)))
+        printf("Error: allocated block %p in tree\n", t);
+    if (GET_SIZE(HDRP(t)) < LARGE_MIN)
+        printf("Error: small block %p of size %u in tree\n",
+               t, GET_SIZE(HDRP(t)));
+    if (*last != NULL && !KEY_GREATER(GET_SIZE(HDRP(t)), t, *last))
+        printf("Error: tree out of order at %p\n", t);
+    *last = t;
+    return n + 1 + checktree(RIGHT(t), last);
+}
+
+#else /* TLSF */
+
+/*
+ * size_class - Map a block size to its TLSF list (fl, sl), flattened to
+ *     fl * SL_COUNT + sl.  Row 0 holds the small sizes in 8-byte steps;
+ *     row f > 0 holds [2^(f+FL_SHIFT-1), 2^(f+FL_SHIFT)) in SL_COUNT
+ *     equal slices.
+ */
+static int size_class(size_t size) {
+    int fl, sl;
+
+    if (size < (1 << FL_SHIFT))
+        return (int)(size >> 3);
+    fl = (int)(8 * sizeof(long)) - 1 - __builtin_clzl(size);
+    sl = (int)(size >> (fl - SL_LOG2)) & (SL_COUNT - 1);
+    fl -= FL_SHIFT - 1;
+    if (fl >= FL_COUNT)
+        return NUM_LISTS - 1;
+    return fl * SL_COUNT + sl;
+}
+
+/*
+ * find_fit - Good-fit search in constant time.  The head of the
+ *     request's own list is tried first; after that the request is
+ *     rounded up to the next slice so that any block on the first
+ *     non-empty list at or above it fits.
+ */
+static void *find_fit(size_t asize){
+    int i = size_class(asize);
+    int fl, sl;
+    unsigned int map;
+
+    if (arena->seg_lists[i] != NULL && asize <= GET_SIZE(HDRP(arena->seg_lists[i])))
+        return arena->seg_lists[i];
+
+    /* Start at the next list: everything on it is larger than asize */
+    if (++i >= NUM_LISTS)
+        return NULL;
+    fl = i / SL_COUNT;
+    sl = i % SL_COUNT;
+
+    map = arena->sl_map[fl] & (~0u << sl);
+    if (map == 0) {
+        map = (fl + 1 < FL_COUNT) ? arena->fl_map & (~0u << (fl + 1)) : 0;
+        if (map == 0)
+            return NULL; /* No fit */
+        fl = __builtin_ctz(map);
+        map = arena->sl_map[fl];
+    }
+    return arena->seg_lists[fl * SL_COUNT + __builtin_ctz(map)];
+}
+
+/*
+ * list_marked - Return whether the bitmaps record list i as non-empty
+ */
+static int list_marked(int i) {
+    return (arena->sl_map[i / SL_COUNT] >> (i % SL_COUNT)) & 1;
+}
+
+static void mark_list(int i) {
+    arena->sl_map[i / SL_COUNT] |= 1u << (i % SL_COUNT);
+    arena->fl_map |= 1u << (i / SL_COUNT);
+}
+
+static void unmark_list(int i) {
+    if ((arena->sl_map[i / SL_COUNT] &= ~(1u << (i % SL_COUNT))) == 0)
+        arena->fl_map &= ~(1u << (i / SL_COUNT));
+}
+#endif /* TLSF */
+
+/*
+ * insert_free - Push free block bp onto the front of its free list (or
+ *     put it in address order, for ORDER_ADDRESS), or into the tree if
+ *     it is large.  A free block at the top of the heap becomes the
+ *     wilderness instead.
+ */
+static void insert_free(void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    int i;
+#if ORDER == ORDER_ADDRESS
+    char *prev, *next;
+#endif
+
+    if (AT_TOP(bp)) {
+        arena->wild = bp;
+        return;
+    }
+    arena->free_bytes += size;
+    arena->free_blocks[STAT_CLASS(size)]++;
+
+#ifndef TLSF
+    if (size >= LARGE_MIN) {
+        tree_insert(bp);
+        return;
+    }
+#endif
+    i = size_class(size);
+
+#if ORDER == ORDER_ADDRESS
+    /* Keep the list in address order */
+    for (prev = NULL, next = arena->seg_lists[i];
+         next != NULL && next < (char *)bp; next = NEXT_FREE(next))
+        prev = next;
+    SET_NEXT_FREE(bp, next);
+    SET_PREV_FREE(bp, prev);
+    if (next != NULL)
+        SET_PREV_FREE(next, bp);
+    if (prev != NULL)
+        SET_NEXT_FREE(prev, bp);
+    else
+        arena->seg_lists[i] = bp;
+#else
+    SET_NEXT_FREE(bp, arena->seg_lists[i]);
+    SET_PREV_FREE(bp, NULL);
+    if (arena->seg_lists[i] != NULL)
+        SET_PREV_FREE(arena->seg_lists[i], bp);
+    arena->seg_lists[i] = bp;
+#endif
+    mark_list(i);
+}
+
+/*
+ * remove_free - Unlink free block bp from its free list or the tree,
+ *     or stop it being the wilderness
+ */
+static void remove_free(void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    int i;
+
+    if (bp == arena->wild) {
+        arena->wild = NULL;
+        return;
+    }
+    arena->free_bytes -= size;
+    arena->free_blocks[STAT_CLASS(size)]--;
+
+#ifndef TLSF
+    if (size >= LARGE_MIN) {
+        tree_remove(bp);
+        return;
+    }
+#endif
+    i = size_class(size);
+
+#if FIT == FIT_NEXT
+    /* Make sure the rover isn't pointing at the block we unlink */
+    if (arena->rover[i] == bp)
+        arena->rover[i] = NEXT_FREE(bp);
 #endif
+    if (PREV_FREE(bp) != NULL)
+        SET_NEXT_FREE(PREV_FREE(bp), NEXT_FREE(bp));
+    else if ((arena->seg_lists[i] = NEXT_FREE(bp)) == NULL)
+        unmark_list(i);
+    if (NEXT_FREE(bp) != NULL)
+        SET_PREV_FREE(NEXT_FREE(bp), PREV_FREE(bp));
 }
 
-static void printblock(void *bp) 
+static void printblock(void *bp)
 {
     size_t hsize, halloc, fsize, falloc;
 
     /*checkheap(0);*/
     hsize = GET_SIZE(HDRP(bp));
-    halloc = GET_ALLOC(HDRP(bp));  
-    fsize = GET_SIZE(FTRP(bp));
-    falloc = GET_ALLOC(FTRP(bp));  
+    halloc = GET_ALLOC(HDRP(bp));
 
     if (hsize == 0) {
     printf("%p: EOL\n", bp);
     return;
     }
 
-    /*  printf("%p: header: [%p:%c] footer: [%p:%c]\n", bp, 
-    hsize, (halloc ? 'a' : 'f'), 
-    fsize, (falloc ? 'a' : 'f')); */
+    if (halloc) {
+    printf("%p: header: [%zu:a]\n", bp, hsize);
+    return;
+    }
+
+    fsize = GET_SIZE(FTRP(bp));
+    falloc = GET_ALLOC(FTRP(bp));
+
+    printf("%p: header: [%zu:%c] footer: [%zu:%c]\n", bp,
+    hsize, (halloc ? 'a' : 'f'),
+    fsize, (falloc ? 'a' : 'f'));
 }
 
-static void checkblock(void *bp) 
+static void checkblock(void *bp)
 {
     if ((size_t)bp % 8)
     printf("Error: %p is not doubleword aligned\n", bp);
-    if (GET(HDRP(bp)) != GET(FTRP(bp)))
+    if (!GET_ALLOC(HDRP(bp)) && GET(HDRP(bp)) != GET(FTRP(bp)))
     printf("Error: header does not match footer\n");
 }
-
@@ -7,6 +7,12 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern void *mm_calloc (size_t nmemb, size_t size);
+extern void mm_free_sized(void *ptr, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t align, size_t size);
+extern void *mm_aligned_alloc(size_t align, size_t size);
+extern size_t mm_usable_size(void *ptr);
+extern size_t mm_good_size(size_t size);
 
 #else
 
@@ -15,11 +21,39 @@ extern void *malloc (size_t size);
 extern void free (void *ptr);
 extern void *realloc(void *ptr, size_t size);
 extern void *calloc (size_t nmemb, size_t size);
+extern void free_sized(void *ptr, size_t size);
+extern void *memalign(size_t align, size_t size);
+extern int posix_memalign(void **memptr, size_t align, size_t size);
+extern void *aligned_alloc(size_t align, size_t size);
+extern size_t malloc_usable_size(void *ptr);
+extern size_t malloc_good_size(size_t size);
 
 #endif
 
 extern int mm_init(void);
 
+/* Allocate n blocks of size bytes into out, returning how many were
+   allocated, and free n blocks at once; see mm.c */
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+extern void mm_free_batch(void **ptrs, size_t n);
+
+/* Heap statistics, kept up to date as the heap changes; see mm.c */
+#define MM_STATS_CLASSES 32
+typedef struct {
+    size_t heap_bytes;    /* Heap bytes, trims deducted */
+    size_t alloc_bytes;   /* ... in allocated blocks */
+    size_t free_bytes;    /* ... in free blocks */
+    size_t parked_bytes;  /* ... freed but not yet coalesced */
+    size_t free_blocks[MM_STATS_CLASSES];  /* Free blocks of 2^i to
+                                              2^(i+1)-1 bytes */
+    size_t largest_free;  /* Size of the biggest free block */
+    size_t mapped_bytes;  /* Bytes in blocks with mappings of their own */
+    size_t sbrks;         /* mem_sbrk calls so far */
+    size_t coalesces[4];  /* Frees with neither neighbour free, only the
+                             next, only the previous, and both */
+} mm_stats_t;
+extern void mm_stats(mm_stats_t *st);
+
 /* This is largely for debugging.  You can do what you want with the
    verbose flag; we don't care. */
 extern void mm_checkheap(int verbose);
@@ -0,0 +1,120 @@
+/*
+ * mtbench.c - Multithreaded scaling benchmark for the -DTHREADS build
+ *
+ * Linked against mm.c built without -DDRIVER, so the plain malloc and
+ * free used here (and by libc itself) are the allocator under test.
+ * Each thread churns through a private set of slots, freeing the
+ * occupant of a random slot or filling it with a new block of random
+ * size.  Most requests are small enough for the thread caches; one in
+ * LARGE_EVERY is bigger and goes to the locked heap.  The threads do
+ * no shared work, so ideal scaling is linear in the thread count.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define MAX_THREADS 16       /* largest thread count measured */
+#define OPS         2000000  /* malloc or free calls per thread */
+#define SLOTS       256      /* live blocks per thread at most */
+#define SMALL_MAX   256      /* small requests are 1..SMALL_MAX bytes */
+#define LARGE_MAX   4096     /* large requests are up to LARGE_MAX bytes */
+#define LARGE_EVERY 32       /* one request in LARGE_EVERY is large */
+
+static pthread_barrier_t start;
+
+/*
+ * xorshift - Per-thread pseudo-random numbers
+ */
+static unsigned int xorshift(unsigned int *state)
+{
+    unsigned int x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/*
+ * churn - Body of each benchmark thread
+ */
+static void *churn(void *arg)
+{
+    unsigned int seed = (unsigned int)(size_t)arg * 2654435761u + 1;
+    void *slot[SLOTS];
+    unsigned int r;
+    size_t size;
+    int i, s;
+
+    memset(slot, 0, sizeof(slot));
+    pthread_barrier_wait(&start);
+
+    for (i = 0; i < OPS; i++) {
+        r = xorshift(&seed);
+        s = r % SLOTS;
+        if (slot[s] != NULL) {
+            free(slot[s]);
+            slot[s] = NULL;
+            continue;
+        }
+        if ((r >> 16) % LARGE_EVERY == 0)
+            size = SMALL_MAX + 1 + (r >> 8) % (LARGE_MAX - SMALL_MAX);
+        else
+            size = 1 + (r >> 8) % SMALL_MAX;
+        if ((slot[s] = malloc(size)) == NULL) {
+            fprintf(stderr, "malloc(%zu) failed\n", size);
+            exit(1);
+        }
+        *(char *)slot[s] = (char)i;    /* touch the block */
+    }
+
+    for (s = 0; s < SLOTS; s++)
+        free(slot[s]);
+    return NULL;
+}
+
+/*
+ * run - Time OPS operations on each of nthreads threads, in seconds
+ */
+static double run(int nthreads)
+{
+    pthread_t tid[MAX_THREADS];
+    struct timespec t0, t1;
+    int i;
+
+    pthread_barrier_init(&start, NULL, nthreads + 1);
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&tid[i], NULL, churn, (void *)(size_t)i) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+
+    pthread_barrier_wait(&start);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < nthreads; i++)
+        pthread_join(tid[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    pthread_barrier_destroy(&start);
+
+    return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+int main(void)
+{
+    double secs, base = 0;
+    double mops;
+    int n;
+
+    printf("%8s %10s %10s %9s\n", "threads", "secs", "Mops/s", "speedup");
+    for (n = 1; n <= MAX_THREADS; n *= 2) {
+        secs = run(n);
+        mops = (double)n * OPS / secs / 1e6;
+        if (n == 1)
+            base = mops;
+        printf("%8d %10.3f %10.2f %9.2f\n", n, secs, mops, mops / base);
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * prodcons.c - Producer/consumer stress test for cross-thread frees
+ *
+ * Each pair of threads shares a single-producer single-consumer queue:
+ * the producer mallocs messages and queues them, and the consumer
+ * frees them.  So every free is of a block from another thread's
+ * arena.  The consumer times each free with the cycle counter, and the
+ * benchmark reports message throughput and the free-side latency
+ * distribution for 1 to MAX_PAIRS pairs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define MAX_PAIRS 8          /* largest number of producer/consumer pairs */
+#define MSGS      100000     /* messages per pair */
+#define RING      1024       /* queue slots per pair */
+#define MIN_MSG   16         /* messages are MIN_MSG..MAX_MSG bytes */
+#define MAX_MSG   1024
+
+typedef struct {
+    void *slot[RING];
+    unsigned int head __attribute__((aligned(64)));  /* next slot to read */
+    unsigned int tail __attribute__((aligned(64)));  /* next slot to write */
+} ring_t;
+
+static ring_t ring[MAX_PAIRS];
+static unsigned int lat[MAX_PAIRS * MSGS];   /* free() cycles per message */
+
+/*
+ * rdtsc - Read the cycle counter
+ */
+static inline unsigned long long rdtsc(void)
+{
+    unsigned int lo, hi;
+
+    __asm__ volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/*
+ * producer - Allocate MSGS messages and queue them
+ */
+static void *producer(void *arg)
+{
+    int id = (int)(size_t)arg;
+    ring_t *r = &ring[id];
+    unsigned int seed = id * 2654435761u + 1;
+    unsigned int tail = r->tail;
+    char *msg;
+    int i;
+
+    for (i = 0; i < MSGS; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        if ((msg = malloc(MIN_MSG + seed % (MAX_MSG - MIN_MSG + 1))) == NULL) {
+            fprintf(stderr, "malloc failed\n");
+            exit(1);
+        }
+        msg[0] = (char)i;               /* touch the message */
+        while (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == RING)
+            sched_yield();
+        r->slot[tail % RING] = msg;
+        __atomic_store_n(&r->tail, ++tail, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/*
+ * consumer - Dequeue MSGS messages and free them, timing each free
+ */
+static void *consumer(void *arg)
+{
+    int id = (int)(size_t)arg;
+    ring_t *r = &ring[id];
+    unsigned int *out = &lat[id * MSGS];
+    unsigned int head = r->head;
+    unsigned long long t0;
+    void *msg;
+    int i;
+
+    for (i = 0; i < MSGS; i++) {
+        while (head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+            sched_yield();
+        msg = r->slot[head % RING];
+        __atomic_store_n(&r->head, ++head, __ATOMIC_RELEASE);
+        t0 = rdtsc();
+        free(msg);
+        out[i] = (unsigned int)(rdtsc() - t0);
+    }
+    return NULL;
+}
+
+static int cmp_uint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+
+    return (x > y) - (x < y);
+}
+
+int main(void)
+{
+    pthread_t tid[2 * MAX_PAIRS];
+    struct timespec t0, t1;
+    double secs, sum;
+    size_t n, j;
+    int pairs, i;
+
+    printf("%6s %10s %8s %8s %8s %8s %10s\n", "pairs", "Mmsg/s",
+           "mean", "p50", "p99", "p99.9", "max");
+    for (pairs = 1; pairs <= MAX_PAIRS; pairs *= 2) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (i = 0; i < pairs; i++) {
+            if (pthread_create(&tid[2*i], NULL, producer, (void *)(size_t)i) ||
+                pthread_create(&tid[2*i+1], NULL, consumer, (void *)(size_t)i)) {
+                fprintf(stderr, "pthread_create failed\n");
+                exit(1);
+            }
+        }
+        for (i = 0; i < 2 * pairs; i++)
+            pthread_join(tid[i], NULL);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+        n = (size_t)pairs * MSGS;
+        for (sum = 0, j = 0; j < n; j++)
+            sum += lat[j];
+        qsort(lat, n, sizeof(lat[0]), cmp_uint);
+        printf("%6d %10.2f %8.0f %8u %8u %8u %10u\n", pairs, n / secs / 1e6,
+               sum / n, lat[n / 2], lat[n * 99 / 100], lat[n * 999 / 1000],
+               lat[n - 1]);
+    }
+    printf("(free latencies in cycles)\n");
+    return 0;
+}